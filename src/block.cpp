@@ -49,6 +49,8 @@ Block::Block()
     stateType(NULL)
 {
     id = global_world()->nextBlockID++;
+    packedBytecode = NULL;
+    nameIndex = NULL;
     gc_register_new_object((CircaObject*) this, TYPES.block, true);
 
     on_block_created(this);
@@ -57,6 +59,8 @@ Block::Block()
 Block::~Block()
 {
     clear_block(this);
+    if (packedBytecode != NULL)
+        bytecode_decref(packedBytecode);
     gc_on_object_deleted((CircaObject*) this);
 }
 
@@ -153,6 +157,7 @@ void Block::append(Term* term)
         ca_assert(term->owningBlock == NULL);
         term->owningBlock = this;
         term->index = _terms.length()-1;
+        name_index_update(term);
     }
 }
 
@@ -178,6 +183,7 @@ void Block::set(int index, Term* term)
 
     setNull(index);
     _terms.setAt(index, term);
+    name_index_invalidate(this);
     if (term != NULL) {
         assert_valid_term(term);
         ca_assert(term->owningBlock == NULL || term->owningBlock == this);
@@ -202,6 +208,8 @@ void Block::insert(int index, Term* term)
     ca_assert(index >= 0);
     ca_assert(index <= _terms.length());
 
+    name_index_invalidate(this);
+
     _terms.append(NULL);
     for (int i=_terms.length()-1; i > index; i--) {
         _terms.setAt(i, _terms[i-1]);
@@ -223,6 +231,8 @@ void Block::move(Term* term, int index)
     if (term->index == index)
         return;
 
+    name_index_invalidate(this);
+
     int dir = term->index < index ? 1 : -1;
 
     for (int i=term->index; i != index; i += dir) {
@@ -244,6 +254,7 @@ void Block::moveToEnd(Term* term)
     _terms.append(term);
     _terms.setAt(index, NULL);
     term->index = _terms.length()-1;
+    name_index_update(term);
 }
 
 void Block::remove(int index)
@@ -272,8 +283,10 @@ void Block::removeNulls()
         }
     }
 
-    if (numDeleted > 0)
+    if (numDeleted > 0) {
         _terms.resize(_terms.length() - numDeleted);
+        name_index_invalidate(this);
+    }
 }
 
 void Block::removeNameBinding(Term* term)
@@ -319,6 +332,7 @@ void Block::bindName(Term* term, Name name)
     term->nameSymbol = name;
     term->name = name_to_string(name);
     update_unique_name(term);
+    name_index_update(term);
 }
 
 void Block::remapPointers(TermMap const& map)
@@ -382,6 +396,7 @@ Block* nested_contents(Term* term)
     if (term->nestedContents == NULL) {
         term->nestedContents = new Block();
         term->nestedContents->owningTerm = term;
+        gc_write_barrier((CircaObject*) term->owningBlock, &term->nestedContents->header);
     }
     return term->nestedContents;
 }
@@ -404,6 +419,7 @@ void remove_nested_contents(Term* term)
 void block_graft_replacement(Block* target, Block* replacement)
 {
     target->owningTerm->nestedContents = replacement;
+    gc_write_barrier((CircaObject*) target->owningTerm->owningBlock, &replacement->header);
     replacement->owningTerm = target->owningTerm;
 
     // Remove owningTerm link from existing block.
@@ -520,6 +536,7 @@ void clear_block(Block* block)
     }
 
     block->_terms.clear();
+    name_index_invalidate(block);
 }
 
 Term* find_term_by_id(Block* block, int id)
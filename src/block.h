@@ -6,6 +6,7 @@
 
 #include "common_headers.h"
 
+#include "bytecode.h"
 #include "names.h"
 #include "gc.h"
 #include "list.h"
@@ -15,6 +16,8 @@
 
 namespace circa {
 
+struct BlockNameIndex;
+
 struct Block
 {
     CircaObject header;
@@ -55,6 +58,14 @@ struct Block
     // Compiled interpreter instructions.
     Value bytecode;
 
+    // Packed form of 'bytecode'. This is the version that the interpreter runs. NULL
+    // when the bytecode is dirty.
+    Bytecode* packedBytecode;
+
+    // Index of name bindings, used by name lookup. NULL if it hasn't been built yet, or
+    // if it was discarded after a change. See name_index_update.
+    BlockNameIndex* nameIndex;
+
     Block();
     ~Block();
 
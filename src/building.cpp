@@ -176,13 +176,9 @@ void append_user(Term* user, Term* usee)
     if (usee != NULL && user != NULL)
         usee->users.appendUnique(user);
 
-    // Check if we added the first user.
-    if (originalUserCount == 0 && user_count(usee) > 0) {
-
-        // for-loop bytecode depends on the user count.
-        if (usee->function == FUNCS.for_func)
-            dirty_bytecode(usee->nestedContents);
-    }
+    // for-loop bytecode depends on which terms use the loop's output.
+    if (usee->function == FUNCS.for_func && user_count(usee) != originalUserCount)
+        dirty_bytecode(usee->nestedContents);
 }
 
 static void remove_user(Term* usee, Term* user)
@@ -191,14 +187,10 @@ static void remove_user(Term* usee, Term* user)
 
     usee->users.remove(user);
 
-    // Check if we removed the last user.
-    if (originalUserCount > 0 && user_count(usee) == 0) {
+    // for-loop bytecode depends on which terms use the loop's output.
+    if (usee->function == FUNCS.for_func && user_count(usee) != originalUserCount)
+        dirty_bytecode(usee->nestedContents);
 
-        // for-loop bytecode depends on the user count.
-        if (usee->function == FUNCS.for_func)
-            dirty_bytecode(usee->nestedContents);
-    }
-    
 }
 
 void possibly_prune_user_list(Term* user, Term* usee)
@@ -249,6 +241,9 @@ void change_function(Term* term, Term* function)
 
     term->function = function;
 
+    if (term->owningBlock != NULL)
+        name_index_update(term);
+
     possibly_prune_user_list(term, previousFunction);
 
     on_create_call(term);
@@ -282,6 +277,7 @@ void change_declared_type(Term *term, Type *newType)
         return;
 
     term->type = newType;
+    gc_write_barrier((CircaObject*) term->owningBlock, (CircaObject*) newType);
 
     set_null(term_value(term));
 
@@ -322,23 +318,22 @@ void rename(Term* termToRename, Name name)
     // term a greater ordinal value.
     termToRename->uniqueOrdinal = 0;
 
-    if (block != NULL) {
-        for (int i=0; i < block->length(); i++) {
-            Term* neighbor = block->get(i);
+    if (block != NULL && name != name_None) {
+        TermList neighbors;
+        name_index_find_bindings(block, name, &neighbors);
+
+        for (int i=0; i < neighbors.length(); i++) {
+            Term* neighbor = neighbors[i];
             if (neighbor == termToRename)
                 continue;
-            if (neighbor == NULL)
-                continue;
 
-            if (neighbor->nameSymbol == name) {
-                // Check if the neighbor has ordinal value 0 (meaning no name collision).
-                // If so, then promote it to 1 (meaning there is a collision.
-                if (neighbor->uniqueOrdinal == 0)
-                    neighbor->uniqueOrdinal = 1;
+            // Check if the neighbor has ordinal value 0 (meaning no name collision).
+            // If so, then promote it to 1 (meaning there is a collision.
+            if (neighbor->uniqueOrdinal == 0)
+                neighbor->uniqueOrdinal = 1;
 
-                if (neighbor->uniqueOrdinal >= termToRename->uniqueOrdinal)
-                    termToRename->uniqueOrdinal = neighbor->uniqueOrdinal + 1;
-            }
+            if (neighbor->uniqueOrdinal >= termToRename->uniqueOrdinal)
+                termToRename->uniqueOrdinal = neighbor->uniqueOrdinal + 1;
         }
     }
 
@@ -720,6 +715,29 @@ float get_step(Term* term)
     return term->floatProp("step", 1.0);
 }
 
+// A call inside an if-block can be a tail call, depending on the terms that follow the
+// if-block. Those terms don't exist yet when the case blocks are finished, so the case
+// blocks get new bytecode once the enclosing block is finished.
+static void dirty_case_block_bytecode(Block* block)
+{
+    for (int i=0; i < block->length(); i++) {
+        Term* term = block->get(i);
+        if (term == NULL || term->function != FUNCS.if_block || term->nestedContents == NULL)
+            continue;
+
+        Block* contents = term->nestedContents;
+        for (int caseIndex=0; caseIndex < contents->length(); caseIndex++) {
+            Term* caseTerm = contents->get(caseIndex);
+            if (caseTerm == NULL || caseTerm->function != FUNCS.case_func
+                    || caseTerm->nestedContents == NULL)
+                continue;
+
+            dirty_bytecode(caseTerm->nestedContents);
+            dirty_case_block_bytecode(caseTerm->nestedContents);
+        }
+    }
+}
+
 void block_start_changes(Block* block)
 {
     if (block->inProgress)
@@ -783,6 +801,7 @@ void block_finish_changes(Block* block)
     block_update_state_type(block);
 
     dirty_bytecode(block);
+    dirty_case_block_bytecode(block);
     refresh_bytecode(block);
 
     block->inProgress = false;
@@ -1051,6 +1070,7 @@ void remove_term(Term* term)
             block->_terms[i]->index = i;
     }
     block->_terms.resize(block->_terms.length()-1);
+    name_index_invalidate(block);
 }
 
 void remap_pointers_quick(Term* term, Term* old, Term* newTerm)
@@ -1078,6 +1098,8 @@ void remap_pointers(Term* term, TermMap const& map)
         set_input(term, i, map.getRemapped(term->input(i)));
 
     term->function = map.getRemapped(term->function);
+    if (term->owningBlock != NULL)
+        name_index_update(term);
 
     // TODO, call changeType if our type is changed
     
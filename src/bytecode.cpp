@@ -0,0 +1,294 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "common_headers.h"
+
+#include "block.h"
+#include "bytecode.h"
+#include "evaluation.h"
+#include "inspection.h"
+#include "kernel.h"
+#include "list.h"
+#include "names.h"
+#include "reflection.h"
+#include "tagged_value.h"
+#include "term.h"
+#include "type.h"
+
+namespace circa {
+
+Bytecode* bytecode_create()
+{
+    Bytecode* bytecode = (Bytecode*) malloc(sizeof(Bytecode));
+    bytecode->refCount = 1;
+    bytecode->opCount = 0;
+    bytecode->opCapacity = 0;
+    bytecode->ops = NULL;
+    bytecode->inputCount = 0;
+    bytecode->inputCapacity = 0;
+    bytecode->inputs = NULL;
+    return bytecode;
+}
+
+void bytecode_incref(Bytecode* bytecode)
+{
+    bytecode->refCount++;
+}
+
+void bytecode_decref(Bytecode* bytecode)
+{
+    ca_assert(bytecode->refCount > 0);
+    bytecode->refCount--;
+
+    if (bytecode->refCount == 0) {
+        free(bytecode->ops);
+        free(bytecode->inputs);
+        free(bytecode);
+    }
+}
+
+static void reserve_ops(Bytecode* bytecode, int count)
+{
+    if (count <= bytecode->opCapacity)
+        return;
+
+    bytecode->opCapacity = count;
+    bytecode->ops = (BytecodeOp*) realloc(bytecode->ops,
+        sizeof(BytecodeOp) * bytecode->opCapacity);
+}
+
+static void reserve_inputs(Bytecode* bytecode, int count)
+{
+    if (count <= bytecode->inputCapacity)
+        return;
+
+    int newCapacity = bytecode->inputCapacity * 2;
+    if (newCapacity < count)
+        newCapacity = count;
+
+    bytecode->inputCapacity = newCapacity;
+    bytecode->inputs = (BytecodeInput*) realloc(bytecode->inputs,
+        sizeof(BytecodeInput) * bytecode->inputCapacity);
+}
+
+static bool block_has_own_frame(Block* block)
+{
+    // The contents of an if-block are never pushed; the interpreter pushes the
+    // chosen case block directly.
+    return block->owningTerm == NULL || block->owningTerm->function != FUNCS.if_block;
+}
+
+int bytecode_find_frame_distance(Block* block, Term* input)
+{
+    if (is_value(input))
+        return FrameDistance_TermValue;
+
+    int distance = 0;
+
+    while (block != input->owningBlock) {
+
+        // A major block is entered with a function call, so its parent frame
+        // depends on the call site.
+        if (is_major_block(block))
+            return FrameDistance_Unknown;
+
+        Block* parent = get_parent_block(block);
+        if (parent == NULL)
+            return FrameDistance_Unknown;
+
+        if (block_has_own_frame(parent))
+            distance++;
+
+        block = parent;
+    }
+
+    return distance;
+}
+
+static BytecodeInput* append_input(Bytecode* bytecode, Block* block, Name action, Term* term)
+{
+    reserve_inputs(bytecode, bytecode->inputCount + 1);
+    BytecodeInput* input = &bytecode->inputs[bytecode->inputCount++];
+    input->action = action;
+    input->term = term;
+    input->registerIndex = term == NULL ? -1 : term->index;
+    input->frameDistance = term == NULL ? FrameDistance_Unknown
+        : bytecode_find_frame_distance(block, term);
+    input->consume = false;
+    input->castType = NULL;
+    input->count = 0;
+    return input;
+}
+
+// Only calls and output copies consume their inputs; other ops may read an input register
+// more than once.
+static bool op_can_consume_inputs(Name op)
+{
+    return op == op_CallBlock || op == op_CallNative || op == op_TailCall
+        || op == op_InlineCopy || op == op_SetField;
+}
+
+// Check if 'consumer' can move 'term' out of its register. Besides being the last use,
+// the register must be written by the term's own op. Terms like loop_index are no-ops
+// whose register is maintained by the interpreter. An extra_output is also a no-op, but
+// its register is rewritten by the call that it belongs to, every time that call runs.
+static bool should_consume(caValue* listBytecode, Term* consumer, Term* term)
+{
+    if (consumer == NULL || !can_consume_output(consumer, term))
+        return false;
+
+    if (is_input_placeholder(term) || term->function == FUNCS.extra_output)
+        return true;
+
+    caValue* termOp = list_get(listBytecode, term->index);
+    return as_int(list_get(termOp, 0)) != op_NoOp;
+}
+
+static void compile_input_action(Block* block, caValue* listBytecode, Term* consumer,
+    caValue* action, Bytecode* output)
+{
+    if (is_null(action)) {
+        append_input(output, block, name_None, NULL);
+
+    } else if (is_term_ref(action)) {
+        Term* term = as_term_ref(action);
+        BytecodeInput* input = append_input(output, block,
+            term == NULL ? name_None : name_Copy, term);
+        input->consume = should_consume(listBytecode, consumer, term);
+
+    } else if (is_list(action)) {
+        Name tag = as_int(list_get(action, 0));
+
+        switch (tag) {
+        case name_Multiple: {
+            int count = list_length(action) - 1;
+            append_input(output, block, name_Multiple, NULL)->count = count;
+            for (int i=0; i < count; i++) {
+                Term* term = as_term_ref(list_get(action, i + 1));
+                BytecodeInput* input = append_input(output, block,
+                    term == NULL ? name_None : name_Copy, term);
+                input->consume = should_consume(listBytecode, consumer, term);
+            }
+            break;
+        }
+        case name_Cast: {
+            BytecodeInput* input = append_input(output, block, name_Cast,
+                as_term_ref(list_get(action, 1)));
+            input->castType = as_type(list_get(action, 2));
+            input->consume = should_consume(listBytecode, consumer, input->term);
+            break;
+        }
+        default:
+            internal_error("Unrecognized input action in bytecode_compile");
+        }
+    } else {
+        internal_error("Unrecognized element type in bytecode_compile");
+    }
+}
+
+static void compile_op(Block* block, caValue* listBytecode, Term* term, caValue* action,
+    BytecodeOp* op, Bytecode* output)
+{
+    int length = list_length(action);
+
+    op->op = as_int(list_get(action, 0));
+    op->firstInput = output->inputCount;
+    op->inputCount = 0;
+    op->outputAction = name_None;
+    op->flag = name_None;
+    op->block = NULL;
+    op->fieldOwner = NULL;
+    op->fieldIndex = -1;
+    op->discardOutput = false;
+
+    // FinishLoop stores its flag at index 1, and has no inputs.
+    if (op->op == op_FinishLoop) {
+        if (length > 1)
+            op->flag = as_int(list_get(action, 1));
+        return;
+    }
+
+    // Index 1: list of input actions.
+    if (length > 1 && is_list(list_get(action, 1))) {
+        caValue* inputs = list_get(action, 1);
+        op->inputCount = list_length(inputs);
+        Term* consumer = op_can_consume_inputs(op->op) ? term : NULL;
+        for (int i=0; i < op->inputCount; i++)
+            compile_input_action(block, listBytecode, consumer, list_get(inputs, i), output);
+    }
+
+    // Index 2: output action.
+    if (length > 2 && is_int(list_get(action, 2)))
+        op->outputAction = as_int(list_get(action, 2));
+
+    if (op->outputAction == name_FlatOutputs && term != NULL)
+        op->discardOutput = is_primary_output_unused(term);
+
+    // Index 3: pushed block, or a flag.
+    if (length > 3) {
+        caValue* extra = list_get(action, 3);
+        if (is_block(extra))
+            op->block = as_block(extra);
+        else if (is_int(extra))
+            op->flag = as_int(extra);
+    }
+
+    // Index 4 and 5: field owner type and field index.
+    if (length > 5) {
+        op->fieldOwner = as_type(list_get(action, 4));
+        op->fieldIndex = as_int(list_get(action, 5));
+    }
+}
+
+void bytecode_compile(Block* block, caValue* listBytecode, Bytecode* output)
+{
+    ca_assert(output->refCount == 1);
+
+    output->opCount = 0;
+    output->inputCount = 0;
+
+    int opCount = list_length(listBytecode);
+    reserve_ops(output, opCount);
+    output->opCount = opCount;
+
+    // The last op is the finish op, which doesn't belong to a term.
+    for (int i=0; i < opCount; i++) {
+        Term* term = i < block->length() ? block->get(i) : NULL;
+        compile_op(block, listBytecode, term, list_get(listBytecode, i), &output->ops[i],
+            output);
+    }
+}
+
+void bytecode_dump(Bytecode* bytecode)
+{
+    for (int pc=0; pc < bytecode->opCount; pc++) {
+        BytecodeOp* op = bytecode_op(bytecode, pc);
+        printf("%d: %s", pc, name_to_string(op->op));
+
+        BytecodeInput* inputs = bytecode_op_inputs(bytecode, op);
+        int cursor = 0;
+        for (int i=0; i < op->inputCount; i++) {
+            BytecodeInput* input = &inputs[cursor++];
+            printf(" %s", name_to_string(input->action));
+            if (input->term != NULL)
+                printf(":%d/%d", input->frameDistance, input->registerIndex);
+            if (input->consume)
+                printf("!");
+            if (input->action == name_Multiple) {
+                for (int j=0; j < input->count; j++, cursor++)
+                    printf(",%d/%d", inputs[cursor].frameDistance, inputs[cursor].registerIndex);
+            }
+        }
+
+        if (op->outputAction != name_None)
+            printf(" -> %s", name_to_string(op->outputAction));
+        if (op->flag != name_None)
+            printf(" %s", name_to_string(op->flag));
+        if (op->block != NULL)
+            printf(" block#%d", op->block->id);
+        if (op->fieldOwner != NULL)
+            printf(" field %s[%d]", op->fieldOwner->nameStr(), op->fieldIndex);
+        printf("\n");
+    }
+}
+
+} // namespace circa
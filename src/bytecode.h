@@ -0,0 +1,134 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#pragma once
+
+#include "common_headers.h"
+
+namespace circa {
+
+// Packed bytecode
+//
+// write_block_bytecode() describes a block's instructions as a List of tagged values,
+// which is easy to build and to print. The interpreter doesn't run that list directly;
+// it's first compiled into this flat format: a contiguous array of fixed-width ops, plus
+// one shared array of input actions which the ops index into.
+//
+// Each input action is resolved at compile time to a (frame distance, register index)
+// pair, so that fetching an input doesn't need to search the stack.
+//
+// Compiled bytecode is refcounted, and is never modified after it's compiled. A Block
+// owns the current version, and each Frame holds a reference to the version it's running.
+// When the block changes, it gets a new Bytecode object, and existing frames keep using
+// the old one until they are updated.
+
+// Special values for BytecodeInput.frameDistance.
+
+// The input is a value term, its value is stored on the term itself.
+const int FrameDistance_TermValue = -1;
+
+// The frame isn't known statically (for example, the input is a module-level term used
+// inside a function). The interpreter needs to search the stack for the owning frame.
+const int FrameDistance_Unknown = -2;
+
+struct BytecodeInput
+{
+    // One of: name_None (no input), name_Copy, name_Cast or name_Multiple.
+    Name action;
+
+    // Source term, used by name_Copy and name_Cast.
+    Term* term;
+
+    // Register index of 'term' inside its owning frame.
+    int registerIndex;
+
+    // Number of parent frames to walk up (starting at the frame that runs this op) to
+    // reach the frame that owns 'term'. May be one of the FrameDistance_ values.
+    int frameDistance;
+
+    // If true, this is the last use of 'term', so its value is moved out of the register
+    // instead of copied. Set by bytecode_compile using can_consume_output.
+    bool consume;
+
+    // Destination type, used by name_Cast.
+    Type* castType;
+
+    // Used by name_Multiple: the number of name_Copy entries that immediately follow
+    // this one. Those entries are packed into a list.
+    int count;
+};
+
+struct BytecodeOp
+{
+    // Op tag, one of the op_* names.
+    Name op;
+
+    // Input actions start at Bytecode.inputs[firstInput]. There are 'inputCount' actions,
+    // but a name_Multiple action is followed by its own packed entries, so the actions
+    // may span more than 'inputCount' array elements.
+    int firstInput;
+    int inputCount;
+
+    // How outputs are written back when a pushed frame is finished. Either
+    // name_FlatOutputs, name_OutputsToList, or name_None.
+    Name outputAction;
+
+    // Extra op-specific flag. Used by op_ForLoop and op_FinishLoop to store
+    // name_LoopProduceOutput.
+    Name flag;
+
+    // Block to push, used by op_CallBlock, op_CallNative and op_TailCall. Also used by
+    // op_GetField and op_SetField, as the call to make when the value isn't a 'fieldOwner'.
+    Block* block;
+
+    // Used by op_GetField and op_SetField: the compound type that was found statically,
+    // and the index of the accessed field in that type.
+    Type* fieldOwner;
+    int fieldIndex;
+
+    // If true, nothing reads the primary output, so it's dropped when the pushed frame is
+    // finished instead of being stored in the register. Set by bytecode_compile using
+    // is_primary_output_unused.
+    bool discardOutput;
+};
+
+struct Bytecode
+{
+    int refCount;
+
+    int opCount;
+    int opCapacity;
+    BytecodeOp* ops;
+
+    int inputCount;
+    int inputCapacity;
+    BytecodeInput* inputs;
+};
+
+// Create an empty Bytecode object, with a refcount of 1.
+Bytecode* bytecode_create();
+void bytecode_incref(Bytecode* bytecode);
+void bytecode_decref(Bytecode* bytecode);
+
+// Compile List-based bytecode (as created by write_block_bytecode) into packed form.
+// 'block' is the block that the bytecode was written for. 'output' should be a newly
+// created object that isn't shared yet.
+void bytecode_compile(Block* block, caValue* listBytecode, Bytecode* output);
+
+// Find the number of frames between a frame running 'block', and the frame that
+// owns 'input'. Returns one of the FrameDistance_ values if there isn't a static answer.
+int bytecode_find_frame_distance(Block* block, Term* input);
+
+inline BytecodeOp* bytecode_op(Bytecode* bytecode, int pc)
+{
+    return &bytecode->ops[pc];
+}
+
+inline BytecodeInput* bytecode_op_inputs(Bytecode* bytecode, BytecodeOp* op)
+{
+    return &bytecode->inputs[op->firstInput];
+}
+
+// Print the packed bytecode, for debugging.
+void bytecode_dump(Bytecode* bytecode);
+
+} // namespace circa
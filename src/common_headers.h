@@ -45,6 +45,7 @@ struct Dict;
 struct Frame;
 struct Stack;
 struct FeedbackOperation;
+struct FieldIndexTable;
 struct FileWatch;
 struct FileWatchWorld;
 struct Function;
@@ -122,6 +123,16 @@ void ca_assert_function(bool result, const char* expr, int line, const char* fil
 #define CIRCA_ENABLE_FILESYSTEM 1
 #endif
 
+// ENABLE_INOTIFY - File watches are notified of changes with inotify, instead of checking
+// the modified time of every watched file. Linux only.
+#ifndef CIRCA_ENABLE_INOTIFY
+#if defined(__linux__) && CIRCA_ENABLE_FILESYSTEM
+#define CIRCA_ENABLE_INOTIFY 1
+#else
+#define CIRCA_ENABLE_INOTIFY 0
+#endif
+#endif
+
 // ENABLE_THREADING - Enables functions that wrap around system threading utils
 #ifndef CIRCA_ENABLE_THREADING
 #define CIRCA_ENABLE_THREADING 1
@@ -132,11 +143,63 @@ void ca_assert_function(bool result, const char* expr, int line, const char* fil
 #define CIRCA_ENABLE_LOGGING 0
 #endif
 
+// ENABLE_THREADED_DISPATCH - run_interpreter uses a direct-threaded dispatch loop. This
+// requires the "labels as values" extension. When disabled, run_interpreter calls
+// step_interpreter for each op.
+#ifndef CIRCA_ENABLE_THREADED_DISPATCH
+#ifdef __GNUC__
+#define CIRCA_ENABLE_THREADED_DISPATCH 1
+#else
+#define CIRCA_ENABLE_THREADED_DISPATCH 0
+#endif
+#endif
+
+// ENABLE_SIMD_DICT_PROBING - Dict lookups use SSE2 to compare a group of 16 control
+// bytes at once. When disabled, the group is compared one byte at a time.
+#ifndef CIRCA_ENABLE_SIMD_DICT_PROBING
+#ifdef __SSE2__
+#define CIRCA_ENABLE_SIMD_DICT_PROBING 1
+#else
+#define CIRCA_ENABLE_SIMD_DICT_PROBING 0
+#endif
+#endif
+
+// ENABLE_SIMD_LIST_MATH - The bulk list math builtins (sum, dot, list_add, ...) use SSE
+// to process four numbers at a time. When disabled, they use scalar loops.
+#ifndef CIRCA_ENABLE_SIMD_LIST_MATH
+#ifdef __SSE2__
+#define CIRCA_ENABLE_SIMD_LIST_MATH 1
+#else
+#define CIRCA_ENABLE_SIMD_LIST_MATH 0
+#endif
+#endif
+
+// ENABLE_SMALL_STRINGS - Strings that fit in a caValue's data field are stored there
+// instead of in a heap allocation. The tag bit is kept in the pointer's low byte, so this
+// needs a little-endian target.
+#ifndef CIRCA_ENABLE_SMALL_STRINGS
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CIRCA_ENABLE_SMALL_STRINGS 1
+#else
+#define CIRCA_ENABLE_SMALL_STRINGS 0
+#endif
+#endif
+
 // ENABLE_PERF_STATS - Enables tracking of internal performance metrics
 #ifndef CIRCA_ENABLE_PERF_STATS
 #define CIRCA_ENABLE_PERF_STATS 1
 #endif
 
+// ENABLE_GC_HEADER_CHECKS - Have the garbage collector check the magic header of every
+// object that it marks. On by default in debug builds.
+#ifndef CIRCA_ENABLE_GC_HEADER_CHECKS
+#ifdef DEBUG
+#define CIRCA_ENABLE_GC_HEADER_CHECKS 1
+#else
+#define CIRCA_ENABLE_GC_HEADER_CHECKS 0
+#endif
+#endif
+
 // ENABLE_HEAP_DEBUGGING
 //
 // Enabling this flag will have us keep a map of all of our allocations
@@ -4,58 +4,171 @@
 
 #include "common_headers.h"
 
+#if CIRCA_ENABLE_SIMD_DICT_PROBING
+#include <emmintrin.h>
+#endif
+
 #include "dict.h"
 #include "kernel.h"
 #include "names.h"
+#include "string_type.h"
 #include "type.h"
 
 namespace circa {
 
+// DictData is a Swiss-table style hash table. Slots are divided into groups of
+// GroupSize, and each slot has a one-byte control value: Control_Empty,
+// Control_Deleted, or the low 7 bits of the key's hash. A lookup compares the control
+// bytes of a whole group at once, and only compares key strings for slots whose control
+// byte matches. Probing moves between groups, and stops at a group that has an empty
+// slot.
+
+const int GroupSize = 16;
+
+// Keys shorter than this are stored inside the slot, longer keys are allocated.
+const int InlineKeySize = 16;
+
+const unsigned char Control_Empty = 0x80;
+const unsigned char Control_Deleted = 0xfe;
+
 struct DictData {
     struct Slot {
-        char* key;
+        // Full hash of the key. Used to skip most string compares, and to regrow
+        // without rehashing.
+        unsigned hash;
+
+        // NULL if the key is stored in 'inlineKey'.
+        char* longKey;
+        char inlineKey[InlineKeySize];
+
         caValue value;
     };
 
+    // Number of slots, a power of two and at least GroupSize.
     int capacity;
     int count;
+
+    // Number of slots marked Control_Deleted.
+    int deleted;
+
     Slot slots[0];
-    // slots has size [capacity].
+    // slots has size [capacity], and is followed by [capacity] control bytes.
 };
 
 namespace dict_t {
 
 // How many slots to create for a brand new dictionary.
-const int INITIAL_SIZE = 10;
+const int INITIAL_SIZE = GroupSize;
 
-// When reallocating a dictionary, how many slots should initially be filled.
-const float INITIAL_LOAD_FACTOR = 0.3;
+static unsigned char* control_bytes(DictData* data)
+{
+    return (unsigned char*) &data->slots[data->capacity];
+}
 
-// The load at which we'll trigger a reallocation.
-const float MAX_LOAD_FACTOR = 0.75;
+static bool slot_is_full(DictData* data, int index)
+{
+    return (control_bytes(data)[index] & 0x80) == 0;
+}
+
+static const char* slot_key(DictData::Slot* slot)
+{
+    return slot->longKey != NULL ? slot->longKey : slot->inlineKey;
+}
 
-int hash_string(const char* str)
+static void set_slot_key(DictData::Slot* slot, const char* key)
 {
-    // Dumb and simple hash function
-    int result = 0;
-    int byte = 0;
-    while (*str != 0) {
-        result = result ^ (*str << (8 * byte));
-        byte = (byte + 1) % 4;
-        str++;
+    size_t length = strlen(key);
+    if (length < (size_t) InlineKeySize) {
+        memcpy(slot->inlineKey, key, length + 1);
+        slot->longKey = NULL;
+    } else {
+        slot->longKey = strdup(key);
     }
+}
+
+static void free_slot_key(DictData::Slot* slot)
+{
+    free(slot->longKey);
+    slot->longKey = NULL;
+    slot->inlineKey[0] = 0;
+}
+
+static unsigned char hash_control_byte(unsigned hash)
+{
+    return (unsigned char) (hash & 0x7f);
+}
+
+static int hash_first_group(DictData* data, unsigned hash)
+{
+    return int((hash >> 7) & unsigned(data->capacity / GroupSize - 1));
+}
+
+// Returns a bitmask of the slots in the group (starting at 'control') whose control
+// byte equals 'value'.
+static unsigned group_match(const unsigned char* control, unsigned char value)
+{
+#if CIRCA_ENABLE_SIMD_DICT_PROBING
+    __m128i group = _mm_loadu_si128((const __m128i*) control);
+    return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) value)));
+#else
+    unsigned mask = 0;
+    for (int i=0; i < GroupSize; i++)
+        if (control[i] == value)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+// Returns a bitmask of the slots in the group that are empty or deleted.
+static unsigned group_match_free(const unsigned char* control)
+{
+#if CIRCA_ENABLE_SIMD_DICT_PROBING
+    return (unsigned) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) control));
+#else
+    unsigned mask = 0;
+    for (int i=0; i < GroupSize; i++)
+        if (control[i] & 0x80)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+static int lowest_bit(unsigned mask)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static int round_up_capacity(int capacity)
+{
+    int result = GroupSize;
+    while (result < capacity)
+        result *= 2;
     return result;
 }
 
 DictData* create_dict(int capacity)
 {
     ca_assert(capacity > 0);
-    DictData* result = (DictData*) malloc(sizeof(DictData) + capacity * sizeof(DictData::Slot));
+    capacity = round_up_capacity(capacity);
+
+    DictData* result = (DictData*) malloc(sizeof(DictData)
+        + capacity * sizeof(DictData::Slot) + capacity);
     result->capacity = capacity;
     result->count = 0;
+    result->deleted = 0;
     memset(result->slots, 0, capacity * sizeof(DictData::Slot));
     for (int s=0; s < capacity; s++)
         initialize_null(&result->slots[s].value);
+    memset(control_bytes(result), Control_Empty, capacity);
 
     #if VERBOSE_LOG
     std::cout << "create_dict: " << result << std::endl;
@@ -75,7 +188,7 @@ void free_dict(DictData* data)
         return;
 
     for (int i=0; i < data->capacity; i++) {
-        free(data->slots[i].key);
+        free(data->slots[i].longKey);
         set_null(&data->slots[i].value);
     }
     free(data);
@@ -85,6 +198,32 @@ void free_dict(DictData* data)
     #endif
 }
 
+// Place a key that isn't in the dictionary yet, and return its index. The caller must
+// make sure that there is room.
+static int insert_new_key(DictData* data, const char* key, unsigned hash)
+{
+    unsigned char* control = control_bytes(data);
+    int groupMask = data->capacity / GroupSize - 1;
+    int group = hash_first_group(data, hash);
+
+    for (int step=1;; step++) {
+        unsigned freeSlots = group_match_free(control + group * GroupSize);
+        if (freeSlots != 0) {
+            int index = group * GroupSize + lowest_bit(freeSlots);
+            if (control[index] == Control_Deleted)
+                data->deleted--;
+            control[index] = hash_control_byte(hash);
+
+            DictData::Slot* slot = &data->slots[index];
+            slot->hash = hash;
+            set_slot_key(slot, key);
+            data->count++;
+            return index;
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
 DictData* grow(DictData* data, int new_capacity)
 {
     DictData* new_data = create_dict(new_capacity);
@@ -95,12 +234,11 @@ DictData* grow(DictData* data, int new_capacity)
 
     // Move all the keys & values over.
     for (int i=0; i < existingCapacity; i++) {
-        DictData::Slot* old_slot = &data->slots[i];
-
-        if (old_slot->key == NULL)
+        if (!slot_is_full(data, i))
             continue;
 
-        int index = insert(&new_data, old_slot->key);
+        DictData::Slot* old_slot = &data->slots[i];
+        int index = insert_new_key(new_data, slot_key(old_slot), old_slot->hash);
         swap(&old_slot->value, &new_data->slots[index].value);
 
         ca_assert(is_null(&old_slot->value));
@@ -112,7 +250,9 @@ DictData* grow(DictData* data, int new_capacity)
 // object, don't use the old one after calling this.
 void grow(DictData** dataPtr)
 {
-    int new_capacity = int((*dataPtr)->count / INITIAL_LOAD_FACTOR);
+    // Size for a load of at most 1/2. If the table is mostly deleted slots, then this
+    // rebuilds it at the same size.
+    int new_capacity = ((*dataPtr)->count + 1) * 2;
     DictData* oldData = *dataPtr;
     *dataPtr = grow(*dataPtr, new_capacity);
     free_dict(oldData);
@@ -125,32 +265,46 @@ DictData* duplicate(DictData* original)
 
     INCREMENT_STAT(DictHardCopy);
 
-    int new_capacity = int(original->count / INITIAL_LOAD_FACTOR);
-    if (new_capacity < INITIAL_SIZE)
-        new_capacity = INITIAL_SIZE;
-
-    DictData* dupe = create_dict(new_capacity);
+    DictData* dupe = create_dict((original->count + 1) * 2);
 
     // Copy all items
     for (int i=0; i < original->capacity; i++) {
-        DictData::Slot* slot = &original->slots[i];
-
-        if (slot->key == NULL)
+        if (!slot_is_full(original, i))
             continue;
 
-        int index = insert(&dupe, slot->key);
+        DictData::Slot* slot = &original->slots[i];
+        int index = insert_new_key(dupe, slot_key(slot), slot->hash);
         copy(&slot->value, &dupe->slots[index].value);
     }
     return dupe;
 }
 
-// Get the 'ideal' slot index, the place we would put this string if there is no
-// collision.
-int find_ideal_slot_index(DictData* data, const char* str)
+static int find_key_with_hash(DictData* data, const char* key, unsigned hash)
 {
-    ca_assert(data->capacity > 0);
-    unsigned int hash = hash_string(str);
-    return int(hash % data->capacity);
+    unsigned char* control = control_bytes(data);
+    unsigned char controlByte = hash_control_byte(hash);
+    int groupCount = data->capacity / GroupSize;
+    int group = hash_first_group(data, hash);
+
+    for (int step=1; step <= groupCount; step++) {
+        unsigned char* groupControl = control + group * GroupSize;
+
+        unsigned matches = group_match(groupControl, controlByte);
+        while (matches != 0) {
+            int index = group * GroupSize + lowest_bit(matches);
+            DictData::Slot* slot = &data->slots[index];
+            if (slot->hash == hash && strcmp(slot_key(slot), key) == 0)
+                return index;
+            matches &= matches - 1;
+        }
+
+        // An empty slot means the key would have been placed in this group.
+        if (group_match(groupControl, Control_Empty) != 0)
+            return -1;
+
+        group = (group + step) & (groupCount - 1);
+    }
+    return -1;
 }
 
 // Insert the given key into the dictionary, returns the index.
@@ -162,34 +316,18 @@ int insert(DictData** dataPtr, const char* key)
         *dataPtr = create_dict();
 
     // Check if this key is already here
-    int existing = find_key(*dataPtr, key);
+    unsigned hash = hash_cstring(key);
+    int existing = find_key_with_hash(*dataPtr, key, hash);
     if (existing != -1)
         return existing;
 
-    // Check if it is time to reallocate
-    if ((*dataPtr)->count >= MAX_LOAD_FACTOR * ((*dataPtr)->capacity))
-        grow(dataPtr);
-
+    // Check if it is time to reallocate. Deleted slots count towards the load, since
+    // lookups have to probe past them.
     DictData* data = *dataPtr;
-    int index = find_ideal_slot_index(data, key);
-
-    // Linearly advance if this slot is being used
-    int starting_index = index;
-    while (data->slots[index].key != NULL) {
-        index = (index + 1) % data->capacity;
-
-        // Die if we made it all the way around
-        if (index == starting_index) {
-            ca_assert(false);
-            return 0;
-        }
-    }
-
-    DictData::Slot* slot = &data->slots[index];
-    slot->key = strdup(key);
-    data->count++;
+    if ((data->count + data->deleted + 1) * 8 > data->capacity * 7)
+        grow(dataPtr);
 
-    return index;
+    return insert_new_key(*dataPtr, key, hash);
 }
 
 void insert_value(DictData** dataPtr, const char* key, caValue* value)
@@ -198,33 +336,12 @@ void insert_value(DictData** dataPtr, const char* key, caValue* value)
     copy(value, &(*dataPtr)->slots[index].value);
 }
 
-// Check if strings are equal, and don't die if either pointer is NULL.
-bool equal_strings(const char* left, const char* right)
-{
-    if (left == NULL || right == NULL) return false;
-    return strcmp(left, right) == 0;
-}
-
 int find_key(DictData* data, const char* key)
 {
     if (data == NULL)
         return -1;
 
-    int index = find_ideal_slot_index(data, key);
-    int starting_index = index;
-    while (!equal_strings(key, data->slots[index].key)) {
-        index = (index + 1) % data->capacity;
-
-        // If we hit an empty slot, then give up.
-        if (data->slots[index].key == NULL)
-            return -1;
-
-        // Or, if we looped around to the starting index, give up.
-        if (index == starting_index)
-            return -1;
-    }
-
-    return index;
+    return find_key_with_hash(data, key, hash_cstring(key));
 }
 
 caValue* get_value(DictData* data, const char* key)
@@ -238,39 +355,27 @@ caValue* get_index(DictData* data, int index)
 {
     ca_assert(index >= 0);
     ca_assert(index < data->capacity);
-    ca_assert(data->slots[index].key != NULL);
+    ca_assert(slot_is_full(data, index));
     return &data->slots[index].value;
 }
 
 void remove_at(DictData* data, int index)
 {
     // Clear out this slot
-    free(data->slots[index].key);
-    data->slots[index].key = NULL;
-    set_null(&data->slots[index].value);
+    DictData::Slot* slot = &data->slots[index];
+    free_slot_key(slot);
+    set_null(&slot->value);
     data->count--;
 
-    // Check if any following keys would prefer to be moved up to this empty slot.
-    while (true) {
-        int prevIndex = index;
-        index = (index+1) % data->capacity;
-
-        DictData::Slot* slot = &data->slots[index];
-
-        if (slot->key == NULL)
-            break;
-
-        // If a slot isn't in its ideal index, then we assume that it would rather be in
-        // this slot.
-        if (find_ideal_slot_index(data, slot->key) != index) {
-            DictData::Slot* prevSlot = &data->slots[prevIndex];
-            prevSlot->key = slot->key;
-            slot->key = NULL;
-            swap(&slot->value, &prevSlot->value);
-            continue;
-        }
-
-        break;
+    // If this group already has an empty slot, then no probe continues past it, and this
+    // slot can be empty too. Otherwise leave a marker so that probes keep going.
+    unsigned char* control = control_bytes(data);
+    unsigned char* groupControl = control + (index / GroupSize) * GroupSize;
+    if (group_match(groupControl, Control_Empty) != 0) {
+        control[index] = Control_Empty;
+    } else {
+        control[index] = Control_Deleted;
+        data->deleted++;
     }
 }
 
@@ -292,14 +397,15 @@ int count(DictData* data)
 void clear(DictData* data)
 {
     for (int i=0; i < data->capacity; i++) {
-        DictData::Slot* slot = &data->slots[i];
-        if (slot->key == NULL)
+        if (!slot_is_full(data, i))
             continue;
-        free(slot->key);
-        slot->key = NULL;
+        DictData::Slot* slot = &data->slots[i];
+        free_slot_key(slot);
         set_null(&slot->value);
     }
+    memset(control_bytes(data), Control_Empty, data->capacity);
     data->count = 0;
+    data->deleted = 0;
 
     #if VERBOSE_LOG
     std::cout << "clear_dict: " << data << std::endl;
@@ -307,9 +413,9 @@ void clear(DictData* data)
 }
 
 struct SortedVisitItem {
-    char* key;
+    const char* key;
     caValue* value;
-    SortedVisitItem(char* k, caValue* v) : key(k), value(v) {}
+    SortedVisitItem(const char* k, caValue* v) : key(k), value(v) {}
 };
 
 struct SortedVisitItemCompare {
@@ -330,11 +436,11 @@ void visit_sorted(DictData* data, DictVisitor visitor, void* context)
     std::set<SortedVisitItem, SortedVisitItemCompare> set;
 
     for (int i=0; i < data->capacity; i++) {
-        DictData::Slot* slot = &data->slots[i];
-        if (slot->key == NULL)
+        if (!slot_is_full(data, i))
             continue;
 
-        set.insert(SortedVisitItem(slot->key, &slot->value));
+        DictData::Slot* slot = &data->slots[i];
+        set.insert(SortedVisitItem(slot_key(slot), &slot->value));
     }
 
     std::set<SortedVisitItem, SortedVisitItemCompare>::const_iterator it;
@@ -345,11 +451,12 @@ void visit_sorted(DictData* data, DictVisitor visitor, void* context)
 void debug_print(DictData* data)
 {
     printf("dict: %p\n", data);
-    printf("count: %d, capacity: %d\n", data->count, data->capacity);
+    printf("count: %d, deleted: %d, capacity: %d\n", data->count, data->deleted,
+        data->capacity);
     for (int i=0; i < data->capacity; i++) {
         DictData::Slot* slot = &data->slots[i];
         const char* key = "<null>";
-        if (slot->key != NULL) key = slot->key;
+        if (slot_is_full(data, i)) key = slot_key(slot);
         printf("[%d] %s = %s\n", i, key, to_string(&data->slots[i].value).c_str());
     }
 }
@@ -362,7 +469,7 @@ void iterator_start(DictData* data, caValue* iterator)
     set_int(iterator, 0);
 
     // Advance if this iterator location isn't valid
-    if (data->slots[0].key == NULL)
+    if (!slot_is_full(data, 0))
         iterator_next(data, iterator);
 }
 
@@ -372,7 +479,7 @@ void iterator_next(DictData* data, caValue* iterator)
 
     // Advance to next valid location
     int next = i + 1;
-    while ((next < data->capacity) && (data->slots[next].key == NULL))
+    while ((next < data->capacity) && !slot_is_full(data, next))
         next++;
 
     if (next >= data->capacity)
@@ -385,7 +492,7 @@ void iterator_get(DictData* data, caValue* iterator, const char** key, caValue**
 {
     int i = as_int(iterator);
 
-    *key = data->slots[i].key;
+    *key = slot_key(&data->slots[i]);
     *value = &data->slots[i].value;
 }
 
@@ -425,9 +532,9 @@ namespace tagged_value_wrappers {
             return;
         Value relativeIdentifier;
         for (int i=0; i < data->capacity; i++) {
-            if (data->slots[i].key == NULL)
+            if (!slot_is_full(data, i))
                 continue;
-            set_string(&relativeIdentifier, data->slots[i].key);
+            set_string(&relativeIdentifier, slot_key(&data->slots[i]));
             callback(&data->slots[i].value, &relativeIdentifier, context);
         }
     }
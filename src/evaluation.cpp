@@ -9,10 +9,12 @@
 #include "evaluation.h"
 #include "function.h"
 #include "generic.h"
+#include "if_block.h"
 #include "inspection.h"
 #include "importing.h"
 #include "kernel.h"
 #include "list.h"
+#include "loops.h"
 #include "parser.h"
 #include "reflection.h"
 #include "stateful_code.h"
@@ -37,6 +39,12 @@ static void bytecode_write_finish_op(caValue* op);
 const int BytecodeIndex_Inputs = 1;
 const int BytecodeIndex_Output = 2;
 
+// Frames are allocated in chunks of this many.
+const int FrameChunkSize = 256;
+
+// Default value for Stack.memoryLimit.
+const size_t DefaultStackMemoryLimit = 1024 * 1024 * 1024;
+
 Stack::Stack()
  : running(false),
    errorOccurred(false),
@@ -45,8 +53,14 @@ Stack::Stack()
     gc_register_new_object((CircaObject*) this, TYPES.eval_context, true);
 
     framesCapacity = 0;
-    frames = NULL;
+    frameChunkCount = 0;
+    frameChunks = NULL;
+    frameCount = 0;
+    memoryLimit = DefaultStackMemoryLimit;
     top = 0;
+    registers = NULL;
+    registersTop = 0;
+    registersCapacity = 0;
     firstFreeFrame = 0;
     lastFreeFrame = 0;
 
@@ -60,7 +74,10 @@ Stack::~Stack()
 
     reset_stack(this);
 
-    free(frames);
+    for (int i=0; i < frameChunkCount; i++)
+        free(frameChunks[i]);
+    free(frameChunks);
+    free(registers);
 
     gc_on_object_deleted((CircaObject*) this);
 }
@@ -86,7 +103,8 @@ void stack_list_references(CircaObject* object, GCReferenceList* list, GCColor c
 static Frame* frame_by_id(Stack* stack, int id)
 {
     ca_assert(id != 0);
-    return &stack->frames[id - 1];
+    int index = id - 1;
+    return &stack->frameChunks[index / FrameChunkSize][index % FrameChunkSize];
 }
 
 static bool is_stop_frame(Frame* frame)
@@ -107,23 +125,28 @@ Frame* frame_by_depth(Stack* stack, int depth)
     return frame;
 }
 
-static void resize_frame_list(Stack* stack, int newCapacity)
+static void grow_frame_list(Stack* stack)
 {
-    // Currently, the frame list can only be grown.
-    ca_assert(newCapacity > stack->framesCapacity);
-
+    // Add one chunk. Existing chunks are not moved.
     int oldCapacity = stack->framesCapacity;
+    int newCapacity = oldCapacity + FrameChunkSize;
+
+    stack->frameChunkCount++;
+    stack->frameChunks = (Frame**) realloc(stack->frameChunks,
+        sizeof(Frame*) * stack->frameChunkCount);
+    stack->frameChunks[stack->frameChunkCount - 1] =
+        (Frame*) malloc(sizeof(Frame) * FrameChunkSize);
     stack->framesCapacity = newCapacity;
-    stack->frames = (Frame*) realloc(stack->frames, sizeof(Frame) * stack->framesCapacity);
 
     for (int i = oldCapacity; i < newCapacity; i++) {
 
         // Initialize new frame
-        Frame* frame = &stack->frames[i];
+        Frame* frame = frame_by_id(stack, i + 1);
         frame->id = i + 1;
         frame->stack = stack;
-        initialize_null(&frame->registers);
-        initialize_null(&frame->bytecode);
+        frame->registerFirst = 0;
+        frame->registerCount = 0;
+        frame->bytecode = NULL;
         frame->blockVersion = 0;
 
         // Except for the last element, this id is updated on next iteration.
@@ -139,28 +162,94 @@ static void resize_frame_list(Stack* stack, int newCapacity)
     }
 }
 
-static Frame* initialize_frame(Stack* stack, FrameId parent, int parentPc, Block* block)
+static void grow_register_arena(Stack* stack, int minimumCapacity)
 {
-    // Check to grow the frames list.
-    if (stack->firstFreeFrame == 0) {
+    int newCapacity = stack->registersCapacity * 2;
+    if (newCapacity < 64)
+        newCapacity = 64;
+    if (newCapacity < minimumCapacity)
+        newCapacity = minimumCapacity;
 
-        int growth = 0;
-        if (stack->framesCapacity < 20)
-            growth = 20;
-        else if (stack->framesCapacity < 100)
-            growth = 80;
-        else
-            growth = 200;
+    stack->registers = (caValue*) realloc(stack->registers, sizeof(caValue) * newCapacity);
 
-        //printf("pre resize:\n");
-        //dump_frames_raw(stack);
-        resize_frame_list(stack, stack->framesCapacity + growth);
+    for (int i=stack->registersCapacity; i < newCapacity; i++)
+        initialize_null(&stack->registers[i]);
+
+    stack->registersCapacity = newCapacity;
+}
 
-        // TEMP
-        //printf("post resize:\n");
-        //dump_frames_raw(stack);
+static void allocate_frame_registers(Stack* stack, Frame* frame, int count)
+{
+    int first = stack->registersTop;
+
+    if (first + count > stack->registersCapacity)
+        grow_register_arena(stack, first + count);
+
+    // Slots outside of a window are null, so the new window is already initialized.
+    frame->registerFirst = first;
+    frame->registerCount = count;
+    stack->registersTop = first + count;
+}
+
+static void release_frame_registers(Stack* stack, Frame* frame)
+{
+    for (int i=0; i < frame->registerCount; i++)
+        set_null(&stack->registers[frame->registerFirst + i]);
+
+    // Frames are popped in the reverse order that they are pushed, so this window is
+    // normally on top.
+    if (frame->registerFirst + frame->registerCount == stack->registersTop)
+        stack->registersTop = frame->registerFirst;
+
+    frame->registerCount = 0;
+}
+
+// Change the size of a frame's window. This is used when a frame's block was modified.
+// Windows above this one are shifted.
+static void resize_frame_registers(Stack* stack, Frame* frame, int count)
+{
+    int delta = count - frame->registerCount;
+    if (delta == 0)
+        return;
+
+    int oldEnd = frame->registerFirst + frame->registerCount;
+    int tailCount = stack->registersTop - oldEnd;
+
+    for (int i=count; i < frame->registerCount; i++)
+        set_null(&stack->registers[frame->registerFirst + i]);
+
+    if (stack->registersTop + delta > stack->registersCapacity)
+        grow_register_arena(stack, stack->registersTop + delta);
+
+    caValue* registers = stack->registers;
+
+    if (tailCount > 0) {
+        memmove(&registers[oldEnd + delta], &registers[oldEnd], sizeof(caValue) * tailCount);
+
+        // Re-initialize the slots that were vacated by the move. Their old contents were
+        // moved, so they aren't released.
+        int vacatedStart = delta > 0 ? oldEnd : stack->registersTop + delta;
+        int vacatedCount = delta > 0 ? delta : -delta;
+        for (int i=0; i < vacatedCount; i++)
+            initialize_null(&registers[vacatedStart + i]);
+
+        for (int i=0; i < stack->framesCapacity; i++) {
+            Frame* other = frame_by_id(stack, i + 1);
+            if (other != frame && other->registerFirst >= oldEnd)
+                other->registerFirst += delta;
+        }
     }
 
+    frame->registerCount = count;
+    stack->registersTop += delta;
+}
+
+static Frame* initialize_frame(Stack* stack, FrameId parent, int parentPc, Block* block)
+{
+    // Check to grow the frames list.
+    if (stack->firstFreeFrame == 0)
+        grow_frame_list(stack);
+
     Frame* frame = frame_by_id(stack, stack->firstFreeFrame);
 
     if (frame->parent == 0) {
@@ -172,6 +261,8 @@ static Frame* initialize_frame(Stack* stack, FrameId parent, int parentPc, Block
         stack->firstFreeFrame = frame->parent;
     }
 
+    stack->frameCount++;
+
     // Initialize frame
     frame->block = block;
     frame->blockVersion = block->version;
@@ -185,16 +276,15 @@ static Frame* initialize_frame(Stack* stack, FrameId parent, int parentPc, Block
     frame->parentPc = parentPc;
 
     // Initialize registers
-    set_list(&frame->registers, get_locals_count(block));
-
-    // Copy bytecode.
-    copy(&block->bytecode, frame_bytecode(frame));
+    allocate_frame_registers(stack, frame, get_locals_count(block));
 
     return frame;
 }
 
 static void release_frame(Stack* stack, Frame* frame)
 {
+    stack->frameCount--;
+
     // Newly freed frames go to the front of the free list.
     if (stack->firstFreeFrame == 0) {
         stack->firstFreeFrame = frame->id;
@@ -218,6 +308,7 @@ Frame* push_frame(Stack* stack, Block* block)
         parentPc = top_frame(stack)->pc;
 
     Frame* frame = initialize_frame(stack, stack->top, parentPc, block);
+    frame_set_bytecode(frame, block->packedBytecode);
 
     // Update 'top'
     stack->top = frame->id;
@@ -228,11 +319,8 @@ Frame* push_frame(Stack* stack, Block* block)
 void pop_frame(Stack* stack)
 {
     Frame* top = top_frame(stack);
-#if 0 // shared register list
-    list_resize(&stack->registers, top->registerFirst);
-#else
-    set_null(&top->registers);
-#endif
+    release_frame_registers(stack, top);
+    frame_set_bytecode(top, NULL);
 
     if (top->parent == 0)
         stack->top = 0;
@@ -300,6 +388,8 @@ Frame* stack_create_expansion(Stack* stack, Frame* parent, Term* term)
     write_term_bytecode(term, &action);
     Block* block = find_pushed_block_for_action(&action);
     Frame* frame = initialize_frame(stack, parent->id, term->index, block);
+    refresh_bytecode(block);
+    frame_set_bytecode(frame, block->packedBytecode);
     return frame;
 }
 
@@ -342,12 +432,12 @@ void finish_frame(Stack* stack)
 
     ca_assert(parentFrame->pc < parentFrame->block->length());
 
-    caValue* callerBytecode = list_get(frame_bytecode(parentFrame), parentFrame->pc);
-    caValue* outputAction = list_get(callerBytecode, 2);
+    BytecodeOp* callerOp = bytecode_op(frame_bytecode(parentFrame), parentFrame->pc);
+    Name outputAction = callerOp->outputAction;
 
     // Copy outputs
 
-    if (as_int(outputAction) == name_FlatOutputs) {
+    if (outputAction == name_FlatOutputs) {
 
         Term* finishedTerm = parentFrame->block->get(parentFrame->pc);
         int outputSlotCount = count_actual_output_terms(finishedTerm);
@@ -382,6 +472,12 @@ void finish_frame(Stack* stack)
             bool success = cast(dest, placeholder->type);
             INCREMENT_STAT(Cast_FinishFrame);
 
+            // Drop a primary output that is never read, so that a value which is also
+            // returned through an extra output (like a method's self) isn't shared with
+            // a dead register.
+            if (success && i == 0 && callerOp->discardOutput)
+                set_null(dest);
+
             if (!success) {
                 Value msg;
                 set_string(&msg, "Couldn't cast output value ");
@@ -395,7 +491,7 @@ void finish_frame(Stack* stack)
                 return;
             }
         }
-    } else if (as_int(outputAction) == name_OutputsToList) {
+    } else if (outputAction == name_OutputsToList) {
         Term* finishedTerm = parentFrame->block->get(parentFrame->pc);
         caValue* dest = get_frame_register(parentFrame, finishedTerm->index);
 
@@ -409,7 +505,7 @@ void finish_frame(Stack* stack)
     } else {
         Value msg;
         set_string(&msg, "Unrecognized output action: ");
-        string_append_quoted(&msg, outputAction);
+        string_append(&msg, name_to_string(outputAction));
         set_error_string(get_frame_register(parentFrame, parentFrame->pc), as_cstring(&msg));
         raise_error(stack);
         return;
@@ -456,20 +552,37 @@ void reset_stack(Stack* stack)
     stack->errorOccurred = false;
 
     // Deallocate registers
+    for (int i=0; i < stack->registersTop; i++)
+        set_null(&stack->registers[i]);
+    stack->registersTop = 0;
+
     for (int i=0; i < stack->framesCapacity; i++) {
-        Frame* frame = &stack->frames[i];
-        set_null(&frame->registers);
+        Frame* frame = frame_by_id(stack, i + 1);
+        frame->registerCount = 0;
+        frame_set_bytecode(frame, NULL);
 
         if (i + 1 == stack->framesCapacity)
             frame->parent = 0;
         else
-            frame->parent = stack->frames[i+1].id;
+            frame->parent = i + 2;
     }
 
+    stack->frameCount = 0;
+
     stack->firstFreeFrame = stack->framesCapacity > 0 ? 1 : 0;
     stack->lastFreeFrame = stack->framesCapacity;
 }
 
+size_t stack_memory_usage(Stack* stack)
+{
+    return stack->frameCount * sizeof(Frame) + stack->registersTop * sizeof(caValue);
+}
+
+void stack_set_memory_limit(Stack* stack, size_t bytes)
+{
+    stack->memoryLimit = bytes;
+}
+
 void evaluate_single_term(Stack* stack, Term* term)
 {
     Frame* frame = push_frame(stack, term->owningBlock);
@@ -515,6 +628,38 @@ caValue* find_stack_value_for_term(Stack* stack, Term* term, int stackDelta)
     }
 }
 
+static caValue* find_stack_value_for_input(Stack* stack, BytecodeInput* input, int stackDelta)
+{
+    if (input->frameDistance == FrameDistance_TermValue)
+        return term_value(input->term);
+
+    if (input->frameDistance >= 0) {
+
+        // Walk the precomputed number of frames. The result is double-checked against
+        // the term, in case this frame was pushed by something other than the normal
+        // block nesting (such as a while-loop iteration), or in case the term's block
+        // was modified since this bytecode was compiled. If it doesn't match, fall back
+        // to a search.
+        Frame* frame = top_frame(stack);
+        int distance = input->frameDistance + stackDelta;
+
+        while (distance > 0 && frame->parent != 0) {
+            frame = frame_by_id(stack, frame->parent);
+            distance--;
+        }
+
+        Term* term = input->term;
+        if (distance == 0 && frame->block == term->owningBlock
+                && input->registerIndex == term->index) {
+            caValue* result = get_frame_register(frame, input->registerIndex);
+            ca_test_assert(result == find_stack_value_for_term(stack, input->term, stackDelta));
+            return result;
+        }
+    }
+
+    return find_stack_value_for_term(stack, input->term, stackDelta);
+}
+
 int num_inputs(Stack* stack)
 {
     return count_input_placeholders(top_frame(stack)->block);
@@ -534,14 +679,112 @@ caValue* get_input(Stack* stack, int index)
     return get_frame_register(top_frame(stack), index);
 }
 
+static bool is_state_term(Term* term)
+{
+    return term->function == FUNCS.declared_state
+        || term->function == FUNCS.unpack_state
+        || term->function == FUNCS.unpack_state_from_list
+        || term->function == FUNCS.unpack_state_list_n
+        || term->function == FUNCS.pack_state
+        || term->function == FUNCS.pack_state_to_list
+        || term->function == FUNCS.pack_state_list_n;
+}
+
+// Input placeholders can be consumed if they are refilled before they are used again:
+// a function's inputs, and a for-loop's rebound values, which are copied from the
+// outputs after every iteration. The first for-loop input is the list being iterated.
+static bool can_consume_input_placeholder(Term* placeholder)
+{
+    if (is_state_input(placeholder))
+        return false;
+
+    Block* block = placeholder->owningBlock;
+    if (is_major_block(block))
+        return true;
+
+    return is_for_loop(block) && get_input_placeholder(block, 0) != placeholder;
+}
+
+// A for-loop's primary output reads the last expression of each iteration, but nothing
+// is saved if the loop's output isn't used.
+static bool is_unused_loop_output(Term* term)
+{
+    return term->boolProp("accumulatingOutput", false)
+        && !for_loop_produces_output(term->owningBlock->owningTerm);
+}
+
+// Module-level values (including the ones in a loop at module level) stay in their
+// registers, because code that is added to the module later can continue from the
+// existing frame and use them. Only values inside a function can be moved or dropped.
+static bool is_inside_function(Term* term)
+{
+    Block* major = term->owningBlock;
+    while (major != NULL && !is_major_block(major))
+        major = get_parent_block(major);
+    return major != NULL && major->owningTerm != NULL && is_function(major->owningTerm);
+}
+
 bool can_consume_output(Term* consumer, Term* input)
 {
-    // Disabled due to a few problems
-    //  - Stateful values were being lost
-    //  - Terms inside of loops were able to consume values outside the loop
-    return false;
+    if (input == NULL || is_value(input))
+        return false;
+
+    // Only consume a value that is computed in the same frame. A value from outside a
+    // loop body would be needed by the next iteration.
+    if (input->owningBlock != consumer->owningBlock)
+        return false;
+
+    if (!is_inside_function(input))
+        return false;
+
+    if (is_input_placeholder(input) && !can_consume_input_placeholder(input))
+        return false;
+
+    // Output placeholders are read when the frame finishes.
+    if (is_output_placeholder(input))
+        return false;
+
+    // State values are saved after the call.
+    if (is_state_term(input) || is_state_term(consumer))
+        return false;
+
+    // This must be the last use: the consumer is the only user, and it uses the input
+    // only once.
+    bool foundConsumer = false;
+    for (int i=0; i < user_count(input); i++) {
+        Term* user = input->users[i];
+        if (user == consumer)
+            foundConsumer = true;
+        else if (!is_unused_loop_output(user))
+            return false;
+    }
+
+    if (!foundConsumer)
+        return false;
 
-    //return !is_value(input) && input->users.length() == 1;
+    int uses = 0;
+    for (int i=0; i < consumer->numInputs(); i++)
+        if (consumer->input(i) == input)
+            uses++;
+
+    return uses == 1;
+}
+
+bool is_primary_output_unused(Term* term)
+{
+    if (!is_inside_function(term) || is_state_term(term))
+        return false;
+
+    // The call's own extra_output terms take the call as an input, but they read their
+    // own registers.
+    for (int i=0; i < user_count(term); i++) {
+        Term* user = term->users[i];
+        if (user->function == FUNCS.extra_output && user->input(0) == term)
+            continue;
+        if (!is_unused_loop_output(user))
+            return false;
+    }
+    return true;
 }
 
 void consume_input(Stack* stack, int index, caValue* dest)
@@ -580,11 +823,8 @@ Block* current_block(Stack* stack)
 
 caValue* get_frame_register(Frame* frame, int index)
 {
-#if 0 // shared register list
-    return list_get(&frame->stack->registers, frame->registerFirst + index);
-#else
-    return list_get(&frame->registers, index);
-#endif
+    ca_assert(index >= 0 && index < frame->registerCount);
+    return &frame->stack->registers[frame->registerFirst + index];
 }
 
 caValue* get_frame_register(Frame* frame, Term* term)
@@ -594,22 +834,31 @@ caValue* get_frame_register(Frame* frame, Term* term)
 
 int frame_register_count(Frame* frame)
 {
-    return list_length(&frame->registers);
+    return frame->registerCount;
 }
 
 caValue* frame_registers(Frame* frame)
 {
-    return &frame->registers;
+    return &frame->stack->registers[frame->registerFirst];
+}
+
+Bytecode* frame_bytecode(Frame* frame)
+{
+    return frame->bytecode;
 }
 
-caValue* frame_bytecode(Frame* frame)
+void frame_set_bytecode(Frame* frame, Bytecode* bytecode)
 {
-    return &frame->bytecode;
+    if (bytecode != NULL)
+        bytecode_incref(bytecode);
+    if (frame->bytecode != NULL)
+        bytecode_decref(frame->bytecode);
+    frame->bytecode = bytecode;
 }
 
 caValue* get_frame_register_from_end(Frame* frame, int index)
 {
-    return list_get(&frame->registers, frame_register_count(frame) - 1 - index);
+    return get_frame_register(frame, frame_register_count(frame) - 1 - index);
 }
 
 caValue* get_top_register(Stack* stack, Term* term)
@@ -745,7 +994,7 @@ void dump_frames_raw(Stack* stack)
         << std::endl;
 
     for (int i=0; i < stack->framesCapacity; i++) {
-        Frame* frame = &stack->frames[i];
+        Frame* frame = frame_by_id(stack, i + 1);
         std::cout << " Frame #" << frame->id << ", parent = " << frame->parent << std::endl;
     }
 }
@@ -807,11 +1056,11 @@ static void update_stack_for_possibly_changed_blockes(Stack* stack)
 
         } else {
 
-            // Resize frame->registers if needed.
-            list_resize(&frame->registers, get_locals_count(frame->block));
+            // Resize the frame's registers if needed.
+            resize_frame_registers(stack, frame, get_locals_count(frame->block));
 
             refresh_bytecode(frame->block);
-            copy(&frame->block->bytecode, &frame->bytecode);
+            frame_set_bytecode(frame, frame->block->packedBytecode);
         }
 
         // Continue to next frame.
@@ -994,6 +1243,139 @@ static void bytecode_write_finish_op(caValue* op)
     set_int(list_get(op, 0), op_FinishFrame);
 }
 
+static bool can_call_native_inline(Term* term, Block* block)
+{
+    if (get_override_for_block(block) == NULL)
+        return false;
+
+    // The function must have a single output, and the call must not have any extra
+    // outputs (such as rebound inputs).
+    return count_output_placeholders(block) == 1 && count_actual_output_terms(term) == 1;
+}
+
+// Check if 'term' is in tail position: its result becomes the output of the enclosing
+// function, and the only things that run afterwards are passing that value along.
+static bool is_in_tail_position(Term* term)
+{
+    while (true) {
+        Block* block = term->owningBlock;
+
+        for (int i=term->index + 1; i < block->length(); i++) {
+            Term* next = block->get(i);
+            if (next == NULL)
+                continue;
+
+            // Returning this term exits the function with its value.
+            if (next->function == FUNCS.return_func)
+                return next->numInputs() == 1 && next->input(0) == term;
+
+            if (is_value(next) || is_output_placeholder(next)
+                    || next->function == FUNCS.comment
+                    || next->function == FUNCS.extra_output
+                    || next->function == FUNCS.exit_point)
+                continue;
+
+            return false;
+        }
+
+        // No return, so the term must be the block's primary output.
+        Term* output = get_output_placeholder(block, 0);
+        if (output == NULL || output->input(0) != term)
+            return false;
+
+        if (is_major_block(block))
+            return true;
+
+        // The output of a case block becomes the output of its if-block.
+        if (!is_case_block(block))
+            return false;
+
+        term = get_parent_term(block->owningTerm);
+        if (term == NULL || term->function != FUNCS.if_block)
+            return false;
+    }
+}
+
+static bool can_tail_call(Term* term, Block* callee)
+{
+    if (!is_major_block(callee) || callee->owningTerm == NULL
+            || get_override_for_block(callee) != NULL)
+        return false;
+
+    Block* function = term->owningBlock;
+    while (!is_major_block(function))
+        function = get_parent_block(function);
+
+    // Module-level code is not a function call.
+    if (function->owningTerm == NULL)
+        return false;
+
+    // The callee's output is used as the function's output, so they must match.
+    if (count_output_placeholders(function) != 1
+            || count_output_placeholders(callee) != 1
+            || count_actual_output_terms(term) != 1)
+        return false;
+
+    if (get_output_placeholder(function, 0)->type != get_output_placeholder(callee, 0)->type)
+        return false;
+
+    return is_in_tail_position(term);
+}
+
+static Type* find_struct_type(Type* type)
+{
+    if (type == NULL || !is_list_based_type(type)
+            || list_get_parameter_type(&type->parameter) != name_StructType)
+        return NULL;
+    return type;
+}
+
+// Check if 'term' calls a field accessor of a struct type (such as P.x), and find the
+// type and field index.
+static bool find_static_field_read(Term* term, Type** owner, int* index)
+{
+    Term* function = term->function;
+    if (function == NULL || term->numInputs() != 1 || count_actual_output_terms(term) != 1
+            || !function->boolProp("fieldAccessor", false))
+        return false;
+
+    Term* typeTerm = function->owningBlock->owningTerm;
+    if (typeTerm == NULL || !is_type(term_value(typeTerm)))
+        return false;
+
+    *owner = find_struct_type(as_type(term_value(typeTerm)));
+    if (*owner == NULL)
+        return false;
+
+    *index = list_find_field_index_by_name(*owner, function->nameStr());
+    return *index != -1;
+}
+
+// Check if 'term' is a set_with_selector that assigns one field of a value whose static
+// type is a struct (such as p.x = 1), and find the type and field index.
+static bool find_static_field_write(Term* term, Type** owner, int* index)
+{
+    if (term->function != FUNCS.set_with_selector || term->numInputs() != 3
+            || term->input(0) == NULL || term->input(2) == NULL)
+        return false;
+
+    Term* selector = term->input(1);
+    if (selector == NULL || selector->function != FUNCS.selector
+            || selector->numInputs() != 1 || selector->input(0) == NULL)
+        return false;
+
+    caValue* fieldName = term_value(selector->input(0));
+    if (!is_value(selector->input(0)) || !is_string(fieldName))
+        return false;
+
+    *owner = find_struct_type(term->input(0)->type);
+    if (*owner == NULL)
+        return false;
+
+    *index = list_find_field_index_by_name(*owner, as_cstring(fieldName));
+    return *index != -1;
+}
+
 void write_term_bytecode(Term* term, caValue* result)
 {
     // Each action has a tag in index 0.
@@ -1050,7 +1432,7 @@ void write_term_bytecode(Term* term, caValue* result)
         write_term_output_instructions(term, result, term->nestedContents); // index 2
 
         // index 3 - a flag which might say LoopProduceOutput
-        if (user_count(term) == 0) {
+        if (!for_loop_produces_output(term)) {
             set_int(list_get(result, 3), name_None);
         } else {
             set_int(list_get(result, 3), name_LoopProduceOutput);
@@ -1141,6 +1523,37 @@ void write_term_bytecode(Term* term, caValue* result)
             set_block(list_get(result, 3), function_contents(specialized));
         }
     }
+
+    // The checks below use the current tag rather than 'tag', since the input instructions
+    // may have replaced the call with an error op.
+    Type* fieldOwner = NULL;
+    int fieldIndex = -1;
+
+    // Check if this is a field access that can be resolved to an index.
+    if (as_int(outputTag) == op_CallBlock
+            && find_static_field_read(term, &fieldOwner, &fieldIndex)) {
+        set_int(outputTag, op_GetField);
+        list_resize(result, 6);
+        set_type(list_get(result, 4), fieldOwner);
+        set_int(list_get(result, 5), fieldIndex);
+    }
+    else if (as_int(outputTag) == op_CallBlock
+            && find_static_field_write(term, &fieldOwner, &fieldIndex)) {
+        set_int(outputTag, op_SetField);
+        list_resize(result, 6);
+        set_type(list_get(result, 4), fieldOwner);
+        set_int(list_get(result, 5), fieldIndex);
+    }
+
+    // Check if this is a native function that can be called inline.
+    else if (as_int(outputTag) == op_CallBlock
+            && can_call_native_inline(term, as_block(list_get(result, 3))))
+        set_int(outputTag, op_CallNative);
+
+    // Check if this call can replace the current function's frame.
+    else if (as_int(outputTag) == op_CallBlock
+            && can_tail_call(term, as_block(list_get(result, 3))))
+        set_int(outputTag, op_TailCall);
 }
 
 void write_block_bytecode(Block* block, caValue* output)
@@ -1169,7 +1582,7 @@ void write_block_bytecode(Block* block, caValue* output)
         set_int(list_get(finishOp, 0), op_FinishLoop);
 
         // Possibly produce output, depending on if this term is used.
-        if ((block->owningTerm != NULL) && user_count(block->owningTerm) > 0) {
+        if ((block->owningTerm != NULL) && for_loop_produces_output(block->owningTerm)) {
             set_int(list_get(finishOp, 1), name_LoopProduceOutput);
         } else {
             set_int(list_get(finishOp, 1), name_None);
@@ -1180,68 +1593,79 @@ void write_block_bytecode(Block* block, caValue* output)
     }
 }
 
-void populate_inputs_from_bytecode(Stack* stack, caValue* inputActions, caValue* outputList,
-        int stackDelta)
+void populate_inputs_from_bytecode(Stack* stack, BytecodeInput* inputs, int inputCount,
+        caValue* outputs, int stackDelta)
 {
-    for (int i=0; i < list_length(inputActions); i++) {
-        caValue* action = list_get(inputActions, i);
-        caValue* dest = list_get(outputList, i);
-
-        if (is_list(action)) {
-
-            // Tagged list
+    BytecodeInput* input = inputs;
 
-            caName tag = as_int(list_get(action, 0));
+    for (int i=0; i < inputCount; i++, input++) {
+        caValue* dest = &outputs[i];
 
-            switch (tag) {
-            case name_Multiple: {
+        switch (input->action) {
+        case name_None:
+            set_null(dest);
+            break;
 
-                // Multiple input: create a list in dest register.
-                int inputCount = list_length(action) - 1;
-                set_list(dest, inputCount);
-                for (int inputIndex=0; inputIndex < inputCount; inputIndex++) {
+        case name_Copy: {
+            // Standard copy, or a move if this is the last use.
+            caValue* inputValue = find_stack_value_for_input(stack, input, stackDelta);
+            if (input->consume) {
+                INCREMENT_STAT(Move_PushedInput);
+                move(inputValue, dest);
+            } else {
+                copy(inputValue, dest);
+            }
+            break;
+        }
 
-                    Term* term = as_term_ref(list_get(action, inputIndex + 1));
-                    caValue* incomingValue = find_stack_value_for_term(stack, term, stackDelta);
-                    caValue* elementValue = list_get(dest, inputIndex);
-                    if (incomingValue != NULL)
-                        copy(incomingValue, elementValue);
-                    else
-                        set_null(elementValue);
+        case name_Multiple: {
+
+            // Multiple input: create a list in dest register. The packed elements
+            // follow this entry.
+            int count = input->count;
+            set_list(dest, count);
+            for (int elementIndex=0; elementIndex < count; elementIndex++) {
+                input++;
+                caValue* incomingValue = find_stack_value_for_input(stack, input, stackDelta);
+                caValue* elementValue = list_get(dest, elementIndex);
+                if (incomingValue == NULL) {
+                    set_null(elementValue);
+                } else if (input->consume) {
+                    INCREMENT_STAT(Move_PushedInput);
+                    move(incomingValue, elementValue);
+                } else {
+                    copy(incomingValue, elementValue);
                 }
-                break;
             }
-            case name_Cast: {
+            break;
+        }
+        case name_Cast: {
+
+            // Cast action: copy (or move) and cast to type.
+            Type* type = input->castType;
+            caValue* inputValue = find_stack_value_for_input(stack, input, stackDelta);
+            if (input->consume) {
+                INCREMENT_STAT(Move_PushedInput);
+                move(inputValue, dest);
 
-                // Cast action: copy and cast to type.
-                Term* term = as_term_ref(list_get(action, 1));
-                Type* type = as_type(list_get(action, 2));
-                caValue* inputValue = find_stack_value_for_term(stack, term, stackDelta);
+                // The original value is gone, so report the value that failed.
+                inputValue = dest;
+            } else {
                 copy(inputValue, dest);
-                bool castSuccess = cast(dest, type);
-                if (!castSuccess) {
-                    circa::Value msg;
-                    set_string(&msg, "Couldn't cast value ");
-                    string_append_quoted(&msg, inputValue);
-                    string_append(&msg, " to type ");
-                    string_append(&msg, &type->name);
-                    raise_error_msg(stack, as_cstring(&msg));
-                }
-                break;
             }
+            bool castSuccess = cast(dest, type);
+            if (!castSuccess) {
+                circa::Value msg;
+                set_string(&msg, "Couldn't cast value ");
+                string_append_quoted(&msg, inputValue);
+                string_append(&msg, " to type ");
+                string_append(&msg, &type->name);
+                raise_error_msg(stack, as_cstring(&msg));
             }
-
-        } else if (is_null(action)) {
-            set_null(dest);
-        } else if (is_term_ref(action)) {
-
-            // Standard copy
-            caValue* inputValue = find_stack_value_for_term(stack,
-                    as_term_ref(action), stackDelta);
-            copy(inputValue, dest);
-
-        } else {
-            internal_error("Unrecognized element type in populate_inputs_from_bytecode");
+            break;
+        }
+        default:
+            internal_error("Unrecognized input action in populate_inputs_from_bytecode");
         }
     }
 }
@@ -1250,46 +1674,205 @@ static Block* find_pushed_block_for_action(caValue* action)
 {
     switch (as_int(list_get(action, 0))) {
     case op_CallBlock:
-        return as_block(list_get(action, 2));
+    case op_CallNative:
+    case op_TailCall:
+    case op_GetField:
+    case op_SetField:
+        return as_block(list_get(action, 3));
     default:
         return NULL;
     }
 }
 
-static void step_interpreter(Stack* stack)
+// Call a native function without running its bytecode. The function still gets a frame,
+// since EvaluateFuncs use the top frame to find their inputs, outputs and caller. But the
+// frame's bytecode isn't copied, and the FireNative and FinishFrame steps are skipped.
+//
+// If the function does something other than writing its output (such as raising an
+// error, pushing a frame, or changing nextPc), then the frame is converted to a normal
+// frame and left on the stack.
+static void call_native_inline(Stack* stack, BytecodeOp* action, BytecodeInput* inputs)
 {
-    INCREMENT_STAT(StepInterpreter);
+    INCREMENT_STAT(CallNative);
 
-    Frame* frame = top_frame(stack);
-    Block* block = frame->block;
+    Block* block = action->block;
+    Frame* caller = top_frame(stack);
+    int callerPc = caller->pc;
 
-    // Advance pc to nextPc
-    frame->pc = frame->nextPc;
-    frame->nextPc = frame->pc + 1;
+    Frame* frame = initialize_frame(stack, caller->id, callerPc, block);
+    FrameId frameId = frame->id;
+    stack->top = frameId;
 
-    ca_assert(frame->pc <= block->length());
+    populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
 
-    // Grab action
-    caValue* action = list_get(frame_bytecode(frame), frame->pc);
-    int op = as_int(list_get(action, 0));
+    if (!error_occurred(stack)) {
+        frame->nextPc = block->length();
+        get_override_for_block(block)(stack);
+    }
+
+    // The override may have pushed or popped frames. If it popped our frame, then the
+    // slot might have been reused for a different block.
+    if (stack->top == frameId && frame->block == block && frame->nextPc == block->length()
+            && !error_occurred(stack)) {
+        Term* placeholder = get_output_placeholder(block, 0);
+
+        if (placeholder->type == TYPES.void_type) {
+            pop_frame(stack);
+            return;
+        }
+
+        caValue* result = get_frame_register(frame, placeholder);
+        caValue* dest = get_frame_register(caller, callerPc);
+        move(result, dest);
+        INCREMENT_STAT(Cast_FinishFrame);
+
+        if (cast(dest, placeholder->type)) {
+            pop_frame(stack);
+            return;
+        }
+
+        Value msg;
+        set_string(&msg, "Couldn't cast output value ");
+        string_append(&msg, to_string(dest).c_str());
+        string_append(&msg, " to type ");
+        string_append(&msg, &placeholder->type->name);
+        set_error_string(result, as_cstring(&msg));
+        frame->pc = placeholder->index;
+        raise_error(stack);
+    }
+
+    // Leave a normal frame behind. (If the slot was reused by push_frame, then it already
+    // has bytecode).
+    if (frame->block == block) {
+        refresh_bytecode(block);
+        frame_set_bytecode(frame, block->packedBytecode);
+    }
+}
+
+// Run a tail call: pop the frames of the enclosing function, and push the callee in its
+// place. When the callee finishes, its output goes straight to the function's caller.
+// write_term_bytecode already checked that the call is in tail position. Returns false
+// if the frames can't be replaced, in which case the op should run as a normal call.
+static bool tail_call(Stack* stack, Frame* frame, BytecodeOp* action, BytecodeInput* inputs)
+{
+    if (action->inputCount > MAX_INPUTS)
+        return false;
+
+    // Find the frame of the enclosing function. Stop frames are where the interpreter
+    // returns to its caller, so they aren't replaced.
+    Frame* function = frame;
+    while (true) {
+        if (function->stop || function->parent == 0)
+            return false;
+        if (is_major_block(function->block))
+            break;
+        function = frame_by_id(stack, function->parent);
+    }
+
+    INCREMENT_STAT(TailCall);
+
+    Block* callee = action->block;
+    int inputCount = action->inputCount;
+
+    // Fetch inputs before popping the frames that they come from.
+    Value incoming[MAX_INPUTS];
+    populate_inputs_from_bytecode(stack, inputs, inputCount, incoming, 0);
+
+    if (!error_occurred(stack)) {
+        while (top_frame(stack) != function)
+            pop_frame(stack);
+        pop_frame(stack);
+
+        Frame* calleeFrame = push_frame(stack, callee);
+        for (int i=0; i < inputCount; i++)
+            move(&incoming[i], get_frame_register(calleeFrame, i));
+    }
+
+    return true;
+}
+
+// Run a single op. 'frame' is the top frame, and its pc is already pointing at 'action'.
+// The op and its inputs are part of the frame's bytecode, so these pointers stay valid
+// while the frame is on the stack.
+static void execute_op(Stack* stack, Frame* frame, BytecodeOp* action, BytecodeInput* inputs)
+{
+    Block* block = frame->block;
+    Name op = action->op;
+
+    // Check the memory limit before any call.
+    switch (op) {
+    case op_CallBlock:
+    case op_CallNative:
+    case op_TailCall:
+    case op_GetField:
+    case op_SetField:
+    case op_DynamicCall:
+    case op_ClosureCall:
+        if (stack_memory_usage(stack) > stack->memoryLimit) {
+            raise_error_msg(stack, "stack overflow");
+            return;
+        }
+    }
 
     // Dispatch op
     switch (op) {
     case op_NoOp:
         break;
     case op_CallBlock: {
-        Block* block = as_block(list_get(action, 3));
-        caValue* inputActions = list_get(action, 1);
-        Frame* frame = push_frame(stack, block);
-        populate_inputs_from_bytecode(stack, inputActions, &frame->registers, 1);
+        Frame* frame = push_frame(stack, action->block);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
+        break;
+    }
+    case op_CallNative:
+        call_native_inline(stack, action, inputs);
+        break;
+    case op_TailCall: {
+        if (tail_call(stack, frame, action, inputs))
+            break;
+
+        Frame* frame = push_frame(stack, action->block);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
+        break;
+    }
+    case op_GetField: {
+        caValue* head = find_stack_value_for_input(stack, &inputs[0], 0);
+        if (head->value_type == action->fieldOwner) {
+            INCREMENT_STAT(GetFieldByIndex);
+            copy(list_get(head, action->fieldIndex), get_frame_register(frame, frame->pc));
+            break;
+        }
+
+        // Not the expected type, use the accessor function.
+        Frame* frame = push_frame(stack, action->block);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
+        break;
+    }
+    case op_SetField: {
+        caValue* head = find_stack_value_for_input(stack, &inputs[0], 0);
+        if (head->value_type == action->fieldOwner) {
+            INCREMENT_STAT(SetFieldByIndex);
+            caValue* out = get_frame_register(frame, frame->pc);
+            if (inputs[0].consume)
+                move(head, out);
+            else
+                copy(head, out);
+            touch(out);
+            copy(find_stack_value_for_input(stack, &inputs[2], 0),
+                list_get(out, action->fieldIndex));
+            break;
+        }
+
+        // Not the expected type, use set_with_selector.
+        Frame* frame = push_frame(stack, action->block);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
         break;
     }
     case op_DynamicCall: {
         circa::Value incomingInputs;
         set_list(&incomingInputs, 2);
 
-        caValue* inputActions = list_get(action, 1);
-        populate_inputs_from_bytecode(stack, inputActions, &incomingInputs, 0);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount,
+            list_get(&incomingInputs, 0), 0);
         // May have a runtime type error.
         if (error_occurred(stack))
             return;
@@ -1305,8 +1888,8 @@ static void step_interpreter(Stack* stack)
         circa::Value incomingInputs;
         set_list(&incomingInputs, 2);
 
-        caValue* inputActions = list_get(action, 1);
-        populate_inputs_from_bytecode(stack, inputActions, &incomingInputs, 0);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount,
+            list_get(&incomingInputs, 0), 0);
         // May have a runtime type error.
         if (error_occurred(stack))
             return;
@@ -1318,16 +1901,14 @@ static void step_interpreter(Stack* stack)
         Frame* frame = push_frame(stack, block);
         caValue* actualInputs = list_get(&incomingInputs, 1);
 
-        caValue* registers = frame_registers(frame);
-
         // Copy incoming inputs.
         int registerWrite = 0;
         for (registerWrite=0; registerWrite < list_length(actualInputs); registerWrite++)
-            copy(list_get(actualInputs, registerWrite), list_get(registers, registerWrite));
+            copy(list_get(actualInputs, registerWrite), get_frame_register(frame, registerWrite));
 
         // Copy closure bindings.
         for (int i=0; i < list_length(bindings); i++)
-            copy(list_get(bindings, i), list_get(registers, registerWrite++));
+            copy(list_get(bindings, i), get_frame_register(frame, registerWrite++));
 
         break;
     }
@@ -1338,17 +1919,15 @@ static void step_interpreter(Stack* stack)
         if (block == NULL)
             return;
         Frame* frame = push_frame(stack, block);
-        caValue* inputActions = list_get(action, 1);
-        populate_inputs_from_bytecode(stack, inputActions, &frame->registers, 1);
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
         break;
     }
     case op_ForLoop: {
         Term* currentTerm = block->get(frame->pc);
         Block* block = for_loop_choose_block(stack, currentTerm);
         Frame* frame = push_frame(stack, block);
-        caValue* inputActions = list_get(action, 1);
-        populate_inputs_from_bytecode(stack, inputActions, &frame->registers, 1);
-        bool enableLoopOutput = as_int(list_get(action, 3)) == name_LoopProduceOutput;
+        populate_inputs_from_bytecode(stack, inputs, action->inputCount, frame_registers(frame), 1);
+        bool enableLoopOutput = action->flag == name_LoopProduceOutput;
         start_for_loop(stack, enableLoopOutput);
         break;
     }
@@ -1359,9 +1938,11 @@ static void step_interpreter(Stack* stack)
     }
     case op_InlineCopy: {
         caValue* currentRegister = get_frame_register(frame, frame->pc);
-        caValue* inputActions = list_get(action, 1);
-        caValue* value = find_stack_value_for_term(stack, as_term_ref(list_get(inputActions, 0)), 0);
-        copy(value, currentRegister);
+        caValue* value = find_stack_value_for_input(stack, &inputs[0], 0);
+        if (inputs[0].consume)
+            move(value, currentRegister);
+        else
+            copy(value, currentRegister);
         break;
     }
     case op_FireNative: {
@@ -1418,7 +1999,7 @@ static void step_interpreter(Stack* stack)
         break;
     }
     case op_FinishLoop: {
-        bool enableLoopOutput = as_int(list_get(action, 1)) == name_LoopProduceOutput;
+        bool enableLoopOutput = action->flag == name_LoopProduceOutput;
         for_loop_finish_iteration(stack, enableLoopOutput);
         break;
     }
@@ -1460,6 +2041,92 @@ static void step_interpreter(Stack* stack)
     }
 }
 
+static void step_interpreter(Stack* stack)
+{
+    INCREMENT_STAT(StepInterpreter);
+
+    Frame* frame = top_frame(stack);
+
+    // Advance pc to nextPc
+    frame->pc = frame->nextPc;
+    frame->nextPc = frame->pc + 1;
+
+    ca_assert(frame->pc <= frame->block->length());
+
+    Bytecode* bytecode = frame_bytecode(frame);
+    BytecodeOp* action = bytecode_op(bytecode, frame->pc);
+    execute_op(stack, frame, action, bytecode_op_inputs(bytecode, action));
+}
+
+#if CIRCA_ENABLE_THREADED_DISPATCH
+
+// Same behavior as calling step_interpreter until the stack stops running, but uses
+// direct-threaded dispatch, and keeps the current frame, pc and register base in locals.
+//
+// Ops that only touch the current frame are handled inline. Every other op goes through
+// execute_op: the frame's pc is synced beforehand, and the locals are reloaded afterwards,
+// since the op may have pushed or popped a frame, changed nextPc, or raised an error.
+static void run_interpreter_threaded(Stack* stack)
+{
+    void* dispatch[op_ErrorTooManyInputs - op_NoOp + 1];
+    for (int i=0; i < op_ErrorTooManyInputs - op_NoOp + 1; i++)
+        dispatch[i] = &&do_general;
+    dispatch[op_NoOp - op_NoOp] = &&do_noop;
+    dispatch[op_SetNull - op_NoOp] = &&do_set_null;
+    dispatch[op_InlineCopy - op_NoOp] = &&do_inline_copy;
+
+    Frame* frame;
+    Bytecode* bytecode;
+    caValue* registers;
+    BytecodeOp* action;
+    int pc;
+
+#define DISPATCH() \
+    INCREMENT_STAT(StepInterpreter); \
+    ca_assert(pc <= frame->block->length()); \
+    action = bytecode_op(bytecode, pc); \
+    goto *dispatch[action->op - op_NoOp];
+
+reload:
+    if (!stack->running)
+        return;
+
+    frame = top_frame(stack);
+    bytecode = frame_bytecode(frame);
+    registers = frame_registers(frame);
+    pc = frame->nextPc;
+    DISPATCH();
+
+do_noop:
+    pc++;
+    DISPATCH();
+
+do_set_null:
+    set_null(&registers[pc]);
+    pc++;
+    DISPATCH();
+
+do_inline_copy: {
+    BytecodeInput* input = bytecode_op_inputs(bytecode, action);
+    if (input->consume)
+        move(find_stack_value_for_input(stack, input, 0), &registers[pc]);
+    else
+        copy(find_stack_value_for_input(stack, input, 0), &registers[pc]);
+    pc++;
+    DISPATCH();
+}
+
+do_general:
+    frame->pc = pc;
+    frame->nextPc = pc + 1;
+    execute_op(stack, frame, action, bytecode_op_inputs(bytecode, action));
+    goto reload;
+
+#undef DISPATCH
+}
+
+#endif
+
 void run_interpreter(Stack* stack)
 {
     start_interpreter_session(stack);
@@ -1467,8 +2134,12 @@ void run_interpreter(Stack* stack)
     stack->errorOccurred = false;
     stack->running = true;
 
+#if CIRCA_ENABLE_THREADED_DISPATCH
+    run_interpreter_threaded(stack);
+#else
     while (stack->running)
         step_interpreter(stack);
+#endif
 }
 
 void run_interpreter_step(Stack* stack)
@@ -1565,7 +2236,10 @@ void evaluate_minimum(Stack* stack, Term* term, caValue* result)
 
     // Push frame, use our custom bytecode.
     push_frame(stack, block);
-    move(&bytecode, frame_bytecode(top_frame(stack)));
+    Bytecode* packed = bytecode_create();
+    bytecode_compile(block, &bytecode, packed);
+    frame_set_bytecode(top_frame(stack), packed);
+    bytecode_decref(packed);
 
     // Start evaluation.
     run_interpreter(stack);
@@ -1612,7 +2286,9 @@ void Frame__registers(caStack* callerStack)
     ca_assert(frame != NULL);
 
     caValue* out = circa_output(callerStack, 0);
-    copy(&frame->registers, out);
+    set_list(out, frame_register_count(frame));
+    for (int i=0; i < frame_register_count(frame); i++)
+        copy(get_frame_register(frame, i), list_get(out, i));
 
     // Touch 'output', as the interpreter may violate immutability.
     touch(out);
@@ -1899,8 +2575,8 @@ CIRCA_EXPORT void circa_restart(caStack* stack)
     top->pc = 0;
     top->nextPc = 0;
 
-    for (int i=0; i < list_length(&top->registers); i++)
-        set_null(list_get(&top->registers, i));
+    for (int i=0; i < frame_register_count(top); i++)
+        set_null(get_frame_register(top, i));
 }
 
 CIRCA_EXPORT void circa_run_function(caStack* stack, caFunction* func, caValue* inputs)
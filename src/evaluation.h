@@ -3,6 +3,7 @@
 #pragma once
 
 #include "common_headers.h"
+#include "bytecode.h"
 #include "dict.h"
 #include "list.h"
 #include "loops.h"
@@ -32,11 +33,13 @@ struct Frame
     // The role or state of this frame.
     caName role;
 
-    // Register values.
-    List registers;
+    // Register values. These are a window into the Stack's register arena.
+    int registerFirst;
+    int registerCount;
 
-    // Bytecode
-    Value bytecode;
+    // Packed bytecode, shared with the block. This holds a reference, so it stays valid
+    // if the block is recompiled while the frame is running.
+    Bytecode* bytecode;
 
     // Source block
     Block* block;
@@ -64,13 +67,29 @@ struct Stack
     // Globally unique ID.
     int id;
 
-    // Frame list
+    // Frame list. Frames are allocated in fixed-size chunks, so growing the list doesn't
+    // move existing frames, and a Frame* stays valid across push_frame.
     int framesCapacity;
-    Frame* frames;
+    int frameChunkCount;
+    Frame** frameChunks;
+
+    // Number of frames that are in use (not in the free list).
+    int frameCount;
+
+    // Limit on the memory used by frames and registers, in bytes. A call that would
+    // go past this limit raises a "stack overflow" error.
+    size_t memoryLimit;
 
     // Topmost frame in the current execution state.
     FrameId top;
 
+    // Register arena. Each frame's registers are a window into this array. Windows are
+    // allocated in push order, so pushing or popping a frame only moves registersTop.
+    // Slots that aren't inside a window are always null.
+    caValue* registers;
+    int registersTop;
+    int registersCapacity;
+
     // First free frame entry. In the frame list, there is a shadow list of free frames.
     FrameId firstFreeFrame;
     FrameId lastFreeFrame;
@@ -145,6 +164,11 @@ void stack_clear_error(Stack* stack);
 // Reset a Stack to its default value.
 void reset_stack(Stack* stack);
 
+// Memory used by the stack's frames and registers, in bytes. This doesn't include
+// memory owned by register values.
+size_t stack_memory_usage(Stack* stack);
+void stack_set_memory_limit(Stack* stack, size_t bytes);
+
 // Push a frame onto the stack.
 Frame* push_frame(Stack* stack, Block* block);
 Frame* push_frame_with_inputs(Stack* stack, Block* block, caValue* inputs);
@@ -178,6 +202,15 @@ void consume_input(Stack* stack, Term* term, caValue* dest);
 void consume_input(Stack* stack, int index, caValue* dest);
 int num_inputs(Stack* stack);
 void consume_inputs_to_list(Stack* stack, List* list);
+
+// Check if 'consumer' is the last use of 'input', so that the input value can be moved
+// out of its register instead of copied.
+bool can_consume_output(Term* consumer, Term* input);
+
+// Check if nothing reads the primary output of the call 'term', so that the value can be
+// dropped when the call finishes.
+bool is_primary_output_unused(Term* term);
+
 caValue* get_output(Stack* stack, int index);
 caValue* get_caller_output(Stack* stack, int index);
 
@@ -189,12 +222,15 @@ caValue* get_frame_register(Frame* frame, int index);
 caValue* get_frame_register(Frame* frame, Term* term);
 caValue* get_frame_register_from_end(Frame* frame, int index);
 int frame_register_count(Frame* frame);
+// Pointer to the frame's first register. The registers are contiguous. This pointer is
+// invalidated when a frame is pushed.
 caValue* frame_registers(Frame* frame);
 
 // Get a register on the topmost frame.
 caValue* get_top_register(Stack* stack, Term* term);
 
-caValue* frame_bytecode(Frame* frame);
+Bytecode* frame_bytecode(Frame* frame);
+void frame_set_bytecode(Frame* frame, Bytecode* bytecode);
 
 EvaluateFunc get_override_for_block(Block* block);
 
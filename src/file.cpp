@@ -191,10 +191,11 @@ void read_text_file(const char* filename, caValue* contentsOut)
 
     // Read raw data.
     touch(contentsOut);
-    char* contentsData = string_initialize(contentsOut, int(file_size + 1));
+    char* contentsData = string_initialize(contentsOut, int(file_size));
     size_t bytesRead = fread(contentsData, 1, file_size, fp);
 
-    contentsData[bytesRead] = 0;
+    if (bytesRead < file_size)
+        string_resize(contentsOut, int(bytesRead));
 
     fclose(fp);
 }
@@ -2,8 +2,14 @@
 
 #include "common_headers.h"
 
+#if CIRCA_ENABLE_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 #include "block.h"
 #include "debug.h"
+#include "fakefs.h"
 #include "file.h"
 #include "list.h"
 #include "modules.h"
@@ -16,22 +22,138 @@ namespace circa {
 
 struct FileWatch
 {
+    FileWatchWorld* owner;
     Value filename;
     Value onChangeActions;
     int lastObservedMtime;
+
+    // Set when an inotify event says that the file was changed. Cleared when the change
+    // is handled or ignored.
+    bool dirty;
 };
 
 struct FileWatchWorld
 {
     std::map<std::string, FileWatch*> watches;
+
+    // Watches that get their changes from inotify events.
+    // For each watched directory descriptor, the watches in that directory by file name.
+    std::map<int, std::map<std::string, FileWatch*> > directories;
+
+    // Watches that have received an event since the last file_watch_check_all.
+    std::vector<FileWatch*> dirtyWatches;
+
+    // Watches that aren't covered by inotify, these are checked by modified-time.
+    std::vector<FileWatch*> polled;
+
+    // -1 if inotify isn't used.
+    int inotifyFd;
 };
 
 FileWatchWorld* create_file_watch_world()
 {
     FileWatchWorld* world = new FileWatchWorld();
+    world->inotifyFd = -1;
+#if CIRCA_ENABLE_INOTIFY
+    world->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
     return world;
 }
 
+void destroy_file_watch_world(FileWatchWorld* world)
+{
+    std::map<std::string, FileWatch*>::iterator it;
+    for (it = world->watches.begin(); it != world->watches.end(); ++it)
+        delete it->second;
+
+#if CIRCA_ENABLE_INOTIFY
+    if (world->inotifyFd != -1)
+        close(world->inotifyFd);
+#endif
+    delete world;
+}
+
+static void file_watch_mark_dirty(FileWatch* watch)
+{
+    if (watch->dirty)
+        return;
+
+    watch->dirty = true;
+    watch->owner->dirtyWatches.push_back(watch);
+}
+
+// Register the watch's directory with inotify, or fall back to polling.
+static void file_watch_listen(FileWatchWorld* fileWatchWorld, FileWatch* watch)
+{
+#if CIRCA_ENABLE_INOTIFY
+    if (fileWatchWorld->inotifyFd != -1 && !fakefs_enabled()) {
+        Value directory;
+        Value name;
+        get_directory_for_filename(&watch->filename, &directory);
+        get_just_filename_for_path(&watch->filename, &name);
+
+        // Watch the directory instead of the file, so that we still see the change when an
+        // editor replaces the file with a rename.
+        int wd = inotify_add_watch(fileWatchWorld->inotifyFd, as_cstring(&directory),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB);
+
+        if (wd != -1) {
+            fileWatchWorld->directories[wd][as_cstring(&name)] = watch;
+            return;
+        }
+    }
+#endif
+
+    fileWatchWorld->polled.push_back(watch);
+}
+
+// Read all pending inotify events, and mark the affected watches as dirty.
+static void file_watch_read_events(FileWatchWorld* fileWatchWorld)
+{
+#if CIRCA_ENABLE_INOTIFY
+    if (fileWatchWorld->inotifyFd == -1)
+        return;
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true) {
+        ssize_t length = read(fileWatchWorld->inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char* pos = buffer; pos < buffer + length; ) {
+            struct inotify_event* event = (struct inotify_event*) pos;
+            pos += sizeof(struct inotify_event) + event->len;
+
+            INCREMENT_STAT(FileWatchEvent);
+
+            // Events were dropped, so any watched file might have changed.
+            if (event->mask & IN_Q_OVERFLOW) {
+                std::map<int, std::map<std::string, FileWatch*> >::const_iterator dir;
+                std::map<std::string, FileWatch*>::const_iterator it;
+                for (dir = fileWatchWorld->directories.begin();
+                        dir != fileWatchWorld->directories.end(); ++dir)
+                    for (it = dir->second.begin(); it != dir->second.end(); ++it)
+                        file_watch_mark_dirty(it->second);
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            std::map<int, std::map<std::string, FileWatch*> >::iterator dir =
+                fileWatchWorld->directories.find(event->wd);
+            if (dir == fileWatchWorld->directories.end())
+                continue;
+
+            std::map<std::string, FileWatch*>::const_iterator it = dir->second.find(event->name);
+            if (it != dir->second.end())
+                file_watch_mark_dirty(it->second);
+        }
+    }
+#endif
+}
+
 FileWatch* find_file_watch(World* world, const char* filename)
 {
     std::map<std::string, FileWatch*>::const_iterator it =
@@ -51,11 +173,14 @@ FileWatch* add_file_watch(World* world, const char* filename)
         return existing;
 
     FileWatch* newWatch = new FileWatch();
+    newWatch->owner = world->fileWatchWorld;
     set_string(&newWatch->filename, filename);
     set_list(&newWatch->onChangeActions, 0);
     newWatch->lastObservedMtime = 0;
+    newWatch->dirty = false;
 
     world->fileWatchWorld->watches[filename] = newWatch;
+    file_watch_listen(world->fileWatchWorld, newWatch);
     return newWatch;
 }
 
@@ -74,15 +199,22 @@ FileWatch* add_file_watch_action(World* world, const char* filename, Value* acti
     return watch;
 }
 
+// Check if the file has changed, either because of an event or a new modified-time, and
+// mark the change as seen.
 static bool file_watch_check_for_update(FileWatch* watch)
 {
+    bool changed = watch->dirty;
+    watch->dirty = false;
+
+    INCREMENT_STAT(FileWatchMtimeCheck);
+
     int latestMtime = file_get_mtime(as_cstring(&watch->filename));
     if (latestMtime != watch->lastObservedMtime) {
         watch->lastObservedMtime = latestMtime;
-        return true;
+        changed = true;
     }
 
-    return false;
+    return changed;
 }
 
 void file_watch_trigger_actions(World* world, FileWatch* watch)
@@ -128,24 +260,53 @@ void file_watch_trigger_actions(World* world, const char* filename)
 
 void file_watch_check_now(World* world, FileWatch* watch)
 {
+    file_watch_read_events(watch->owner);
+
     if (file_watch_check_for_update(watch))
         file_watch_trigger_actions(world, watch);
 }
 
 void file_watch_ignore_latest_change(FileWatch* watch)
 {
+    file_watch_read_events(watch->owner);
     file_watch_check_for_update(watch);
 }
 
 void file_watch_check_all(World* world)
 {
-    std::map<std::string, FileWatch*>::const_iterator it;
+    FileWatchWorld* fileWatchWorld = world->fileWatchWorld;
+
+    // inotify doesn't see changes to the fake filesystem, so check everything.
+    if (fakefs_enabled()) {
+        std::map<std::string, FileWatch*>::const_iterator it;
+
+        for (it = fileWatchWorld->watches.begin();
+             it != fileWatchWorld->watches.end();
+             ++it) {
+            FileWatch* watch = it->second;
+            file_watch_check_now(world, watch);
+        }
+        return;
+    }
+
+    file_watch_read_events(fileWatchWorld);
+
+    // Take the list first, running an action might add watches or read more events.
+    std::vector<FileWatch*> changed;
+    changed.swap(fileWatchWorld->dirtyWatches);
+
+    for (size_t i=0; i < changed.size(); i++) {
+        // Skip watches whose change was already handled by file_watch_check_now.
+        if (!changed[i]->dirty)
+            continue;
+        if (file_watch_check_for_update(changed[i]))
+            file_watch_trigger_actions(world, changed[i]);
+    }
 
-    for (it = world->fileWatchWorld->watches.begin();
-         it != world->fileWatchWorld->watches.end();
-         ++it) {
-        FileWatch* watch = it->second;
-        file_watch_check_now(world, watch);
+    for (size_t i=0; i < fileWatchWorld->polled.size(); i++) {
+        FileWatch* watch = fileWatchWorld->polled[i];
+        if (file_watch_check_for_update(watch))
+            file_watch_trigger_actions(world, watch);
     }
 }
 
@@ -22,12 +22,14 @@
  * A file watch can be created manually (such as with add_file_watch_action() and variants).
  * But usually the watch is created implicitly, such as when loading the module.
  *
- * The function file_watch_check_all() will look at every watched file, and runs the actions
- * for every file that has changed since the last call. This function should be called as often
- * as you want file changes to appear in the runtime.
+ * The function file_watch_check_all() runs the actions for every file that has changed since
+ * the last call. This function should be called as often as you want file changes to appear
+ * in the runtime.
  *
- * In the future we'll support efficient file change watching (such as with inotify), but for
- * now we simply load the file's modified-time on every check.
+ * On Linux (when CIRCA_ENABLE_INOTIFY is on), each watched file's directory is registered
+ * with inotify, and file_watch_check_all() only reads the pending events and checks the files
+ * that they mention. Elsewhere, or when the fake filesystem is enabled, or if a directory
+ * couldn't be watched, we fall back to loading each file's modified-time on every check.
  *
  */
 
@@ -39,6 +41,9 @@ struct FileWatchWorld;
 
 FileWatchWorld* create_file_watch_world();
 
+// Free all watches, and close the inotify descriptor.
+void destroy_file_watch_world(FileWatchWorld* world);
+
 // Add a file watch on the given file.
 FileWatch* add_file_watch_action(World* world, const char* filename, Value* action);
 
@@ -20,9 +20,11 @@ namespace get_index_function {
             return circa_output_error(stack, indexStr);
         }
 
-        caValue* result = get_index(list, index);
-
-        copy(result, circa_output(stack, 0));
+        // Lists are read with list_copy_element, so that a packed list stays packed.
+        if (is_list(list))
+            list_copy_element(list, index, circa_output(stack, 0));
+        else
+            copy(get_index(list, index), circa_output(stack, 0));
         cast(circa_output(stack, 0), declared_type((Term*) circa_caller_term(stack)));
     }
     Type* specializeType(Term* term)
@@ -0,0 +1,311 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include <algorithm>
+#include <vector>
+
+#include "circa/internal/for_hosted_funcs.h"
+
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+#include <xmmintrin.h>
+#endif
+
+namespace circa {
+namespace list_math_function {
+
+    // Bulk math on lists of numbers.
+    //
+    // Each input list is read into a contiguous float array first. A list that's packed
+    // as floats is used in place, anything else is converted (ints become floats). The
+    // kernels work on raw arrays: the SSE path handles four elements at a time, and a
+    // scalar loop handles the rest (or everything, when SIMD is disabled). Lists that
+    // are produced by these functions are packed as floats.
+
+    struct FloatArray
+    {
+        const float* items;
+        int count;
+        std::vector<float> converted;
+    };
+
+    static bool read_float_array(caStack* stack, int inputIndex, FloatArray* out)
+    {
+        caValue* list = circa_input(stack, inputIndex);
+        out->count = list_length(list);
+
+        if (list_packed_type(list) == TYPES.float_type) {
+            out->items = list_packed_floats(list);
+            return true;
+        }
+
+        out->converted.resize(out->count);
+        for (int i=0; i < out->count; i++) {
+            Value element;
+            list_copy_element(list, i, &element);
+            if (!is_int(&element) && !is_float(&element)) {
+                char msg[80];
+                sprintf(msg, "Element %d is not a number", i);
+                circa_output_error(stack, msg);
+                return false;
+            }
+            out->converted[i] = to_float(&element);
+        }
+        out->items = out->count > 0 ? &out->converted[0] : NULL;
+        return true;
+    }
+
+    static bool check_same_length(caStack* stack, FloatArray* a, FloatArray* b)
+    {
+        if (a->count == b->count)
+            return true;
+
+        char msg[80];
+        sprintf(msg, "Lists have different lengths: %d and %d", a->count, b->count);
+        circa_output_error(stack, msg);
+        return false;
+    }
+
+    static float* create_output(caStack* stack, int count)
+    {
+        caValue* out = circa_output(stack, 0);
+        set_packed_list(out, TYPES.float_type, count);
+        return list_packed_floats(out);
+    }
+
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+    static float horizontal_sum(__m128 v)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, v);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+#endif
+
+    // Kernels
+
+    static float kernel_sum(const float* a, int count)
+    {
+        int i = 0;
+        float sum = 0;
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4)
+            acc = _mm_add_ps(acc, _mm_loadu_ps(a + i));
+        sum = horizontal_sum(acc);
+#endif
+        for (; i < count; i++)
+            sum += a[i];
+        return sum;
+    }
+
+    static float kernel_dot(const float* a, const float* b, int count)
+    {
+        int i = 0;
+        float sum = 0;
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum = horizontal_sum(acc);
+#endif
+        for (; i < count; i++)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    // 'count' must be at least 1.
+    static float kernel_min(const float* a, int count)
+    {
+        int i = 0;
+        float result = a[0];
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        if (count >= 4) {
+            __m128 acc = _mm_loadu_ps(a);
+            for (i = 4; i + 4 <= count; i += 4)
+                acc = _mm_min_ps(acc, _mm_loadu_ps(a + i));
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        }
+#endif
+        for (; i < count; i++)
+            result = std::min(result, a[i]);
+        return result;
+    }
+
+    static float kernel_max(const float* a, int count)
+    {
+        int i = 0;
+        float result = a[0];
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        if (count >= 4) {
+            __m128 acc = _mm_loadu_ps(a);
+            for (i = 4; i + 4 <= count; i += 4)
+                acc = _mm_max_ps(acc, _mm_loadu_ps(a + i));
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+        }
+#endif
+        for (; i < count; i++)
+            result = std::max(result, a[i]);
+        return result;
+    }
+
+    struct AddOp {
+        static float apply(float a, float b) { return a + b; }
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        static __m128 apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+#endif
+    };
+
+    struct SubOp {
+        static float apply(float a, float b) { return a - b; }
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        static __m128 apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+#endif
+    };
+
+    struct MultOp {
+        static float apply(float a, float b) { return a * b; }
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        static __m128 apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+#endif
+    };
+
+    struct DivOp {
+        static float apply(float a, float b) { return a / b; }
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        static __m128 apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+#endif
+    };
+
+    template <typename Op>
+    static void kernel_elementwise(const float* a, const float* b, float* out, int count)
+    {
+        int i = 0;
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, Op::apply(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+        for (; i < count; i++)
+            out[i] = Op::apply(a[i], b[i]);
+    }
+
+    static void kernel_scale(const float* a, float factor, float* out, int count)
+    {
+        int i = 0;
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        __m128 f = _mm_set1_ps(factor);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), f));
+#endif
+        for (; i < count; i++)
+            out[i] = a[i] * factor;
+    }
+
+    static void kernel_clamp(const float* a, float minVal, float maxVal, float* out, int count)
+    {
+        int i = 0;
+#if CIRCA_ENABLE_SIMD_LIST_MATH
+        __m128 lo = _mm_set1_ps(minVal);
+        __m128 hi = _mm_set1_ps(maxVal);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(a + i), lo), hi));
+#endif
+        for (; i < count; i++)
+            out[i] = std::min(std::max(a[i], minVal), maxVal);
+    }
+
+    // Builtins
+
+    void sum(caStack* stack)
+    {
+        FloatArray a;
+        if (!read_float_array(stack, 0, &a))
+            return;
+        set_float(circa_output(stack, 0), kernel_sum(a.items, a.count));
+    }
+
+    void dot(caStack* stack)
+    {
+        FloatArray a, b;
+        if (!read_float_array(stack, 0, &a) || !read_float_array(stack, 1, &b)
+                || !check_same_length(stack, &a, &b))
+            return;
+        set_float(circa_output(stack, 0), kernel_dot(a.items, b.items, a.count));
+    }
+
+    void list_min(caStack* stack)
+    {
+        FloatArray a;
+        if (!read_float_array(stack, 0, &a))
+            return;
+        if (a.count == 0)
+            return circa_output_error(stack, "Empty list");
+        set_float(circa_output(stack, 0), kernel_min(a.items, a.count));
+    }
+
+    void list_max(caStack* stack)
+    {
+        FloatArray a;
+        if (!read_float_array(stack, 0, &a))
+            return;
+        if (a.count == 0)
+            return circa_output_error(stack, "Empty list");
+        set_float(circa_output(stack, 0), kernel_max(a.items, a.count));
+    }
+
+    template <typename Op>
+    void elementwise(caStack* stack)
+    {
+        FloatArray a, b;
+        if (!read_float_array(stack, 0, &a) || !read_float_array(stack, 1, &b)
+                || !check_same_length(stack, &a, &b))
+            return;
+        kernel_elementwise<Op>(a.items, b.items, create_output(stack, a.count), a.count);
+    }
+
+    void list_scale(caStack* stack)
+    {
+        FloatArray a;
+        if (!read_float_array(stack, 0, &a))
+            return;
+        kernel_scale(a.items, circa_float_input(stack, 1), create_output(stack, a.count),
+            a.count);
+    }
+
+    void list_clamp(caStack* stack)
+    {
+        FloatArray a;
+        if (!read_float_array(stack, 0, &a))
+            return;
+        kernel_clamp(a.items, circa_float_input(stack, 1), circa_float_input(stack, 2),
+            create_output(stack, a.count), a.count);
+    }
+
+    void setup(Block* kernel)
+    {
+        import_function(kernel, sum, "sum(List numbers) -> number;"
+            "'Returns the sum of a list of numbers'");
+        import_function(kernel, dot, "dot(List a, List b) -> number;"
+            "'Returns the dot product of two lists of numbers'");
+        import_function(kernel, list_min, "list_min(List numbers) -> number;"
+            "'Returns the smallest number in a list'");
+        import_function(kernel, list_max, "list_max(List numbers) -> number;"
+            "'Returns the largest number in a list'");
+        import_function(kernel, elementwise<AddOp>, "list_add(List a, List b) -> List;"
+            "'Adds two lists of numbers element by element'");
+        import_function(kernel, elementwise<SubOp>, "list_sub(List a, List b) -> List;"
+            "'Subtracts two lists of numbers element by element'");
+        import_function(kernel, elementwise<MultOp>, "list_mult(List a, List b) -> List;"
+            "'Multiplies two lists of numbers element by element'");
+        import_function(kernel, elementwise<DivOp>, "list_div(List a, List b) -> List;"
+            "'Divides two lists of numbers element by element'");
+        import_function(kernel, list_scale, "list_scale(List numbers, number factor) -> List;"
+            "'Multiplies each number in a list by factor'");
+        import_function(kernel, list_clamp,
+            "list_clamp(List numbers, number minVal, number maxVal) -> List;"
+            "'Clamps each number in a list to the range [minVal, maxVal]'");
+    }
+}
+} // namespace circa
@@ -12,12 +12,13 @@ namespace range_function {
 
         int count = abs(max-start);
         caValue* output = circa_output(stack, 0);
-        set_list(output, count);
+        set_packed_list(output, TYPES.int_type, count);
+        int* items = list_packed_ints(output);
 
         int val = start;
         int increment = start < max ? 1 : -1;
         for (int i=0; i < count; i++) {
-            set_int(list_get(output, i), val);
+            items[i] = val;
             val += increment;
         }
     }
@@ -10,9 +10,7 @@ namespace set_index_function {
         INCREMENT_STAT(SetIndex);
 
         copy(INPUT(0), OUTPUT);
-        touch(OUTPUT);
-        int index = INT_INPUT(1);
-        copy(INPUT(2), list_get(OUTPUT,index));
+        set_index(OUTPUT, INT_INPUT(1), INPUT(2));
     }
 
     Type* specializeType(Term* caller)
@@ -1,5 +1,12 @@
 // Copyright (c) Andrew Fischer. See LICENSE file for license terms.
 
+#include "common_headers.h"
+
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif
+
+#include "debug.h"
 #include "gc.h"
 #include "names.h"
 #include "tagged_value.h"
@@ -7,9 +14,130 @@
 
 namespace circa {
 
-// Global GC zone
+// Number of work units (objects visited) between checks of the time budget.
+const int GCStepChunkSize = 32;
+
+// The 'color' that's passed to gc_mark and to gcListReferences says which kind of
+// collection is marking. The mark state itself is kept in GCState.markBits.
+const GCColor GCColor_Major = 1;
+const GCColor GCColor_Minor = 2;
+
+#if defined(__GNUC__)
+#define GC_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define GC_PREFETCH(addr)
+#endif
+
+enum GCPhase {
+    GCPhase_Idle,
+    GCPhase_MarkRoots,
+    GCPhase_Mark,
+    GCPhase_Sweep
+};
+
+struct GCState
+{
+    GCPhase phase;
+
+    // Mark bits, one per object, indexed by CircaObject.gcIndex. Index 0 is never handed
+    // out, it means that the object isn't registered.
+    unsigned* markBits;
+    int markBitsWords;
+    int nextIndex;
+
+    // Indexes of deleted objects, which are reused before 'nextIndex' grows.
+    int* freeIndexes;
+    int freeIndexCount;
+    int freeIndexCapacity;
+
+    // The mark stack. Holds gray objects: marked, but their references haven't been
+    // scanned yet. Its capacity is reserved when a collection starts, so that pushing
+    // doesn't need to reallocate.
+    GCReferenceList gray;
+
+    // Position in the object lists, used by the MarkRoots and Sweep phases (and by the
+    // sweep of a minor collection). The young list is walked first, then the old list, so
+    // that objects are visited newest first.
+    CircaObject* cursor;
+    bool cursorInOld;
+
+    // Old objects that might reference young objects. See gc_write_barrier.
+    GCReferenceList remembered;
+
+    GCState()
+      : phase(GCPhase_Idle), markBits(NULL), markBitsWords(0), nextIndex(1),
+        freeIndexes(NULL), freeIndexCount(0), freeIndexCapacity(0),
+        cursor(NULL), cursorInOld(false) {}
+};
+
+// Global GC zone. Objects start out on the young list (the nursery), and are moved to
+// the old list when they survive a minor collection.
 CircaObject* g_first = NULL;
-bool g_currentlyCollecting = false;
+CircaObject* g_young = NULL;
+GCState g_gc;
+
+static bool gc_is_marking()
+{
+    return g_gc.phase == GCPhase_MarkRoots || g_gc.phase == GCPhase_Mark;
+}
+
+static int gc_alloc_index()
+{
+    if (g_gc.freeIndexCount > 0)
+        return g_gc.freeIndexes[--g_gc.freeIndexCount];
+
+    int index = g_gc.nextIndex++;
+    int words = index / 32 + 1;
+    if (words > g_gc.markBitsWords) {
+        int newWords = g_gc.markBitsWords < 64 ? 64 : g_gc.markBitsWords * 2;
+        g_gc.markBits = (unsigned*) realloc(g_gc.markBits, sizeof(unsigned) * newWords);
+        memset(g_gc.markBits + g_gc.markBitsWords, 0,
+            sizeof(unsigned) * (newWords - g_gc.markBitsWords));
+        g_gc.markBitsWords = newWords;
+    }
+    return index;
+}
+
+static void gc_free_index(int index)
+{
+    if (g_gc.freeIndexCount >= g_gc.freeIndexCapacity) {
+        g_gc.freeIndexCapacity = g_gc.freeIndexCapacity < 64 ? 64 : g_gc.freeIndexCapacity * 2;
+        g_gc.freeIndexes = (int*) realloc(g_gc.freeIndexes,
+            sizeof(int) * g_gc.freeIndexCapacity);
+    }
+    g_gc.freeIndexes[g_gc.freeIndexCount++] = index;
+}
+
+static inline bool gc_is_marked(CircaObject* obj)
+{
+    return (g_gc.markBits[obj->gcIndex >> 5] & (1u << (obj->gcIndex & 31))) != 0;
+}
+
+static inline void gc_set_marked(CircaObject* obj)
+{
+    g_gc.markBits[obj->gcIndex >> 5] |= 1u << (obj->gcIndex & 31);
+}
+
+static inline void gc_clear_marked(CircaObject* obj)
+{
+    g_gc.markBits[obj->gcIndex >> 5] &= ~(1u << (obj->gcIndex & 31));
+}
+
+static int gc_registered_count()
+{
+    return g_gc.nextIndex - 1 - g_gc.freeIndexCount;
+}
+
+static uint64 gc_now_micros()
+{
+#ifdef _MSC_VER
+    return (uint64) clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
 
 void gc_register_object(CircaObject* obj)
 {
@@ -17,85 +145,295 @@ void gc_register_object(CircaObject* obj)
     ca_assert(obj->next == NULL);
     ca_assert(obj->prev == NULL);
 
-    // Can't create an object while collecting
-    ca_assert(!g_currentlyCollecting);
+    obj->young = true;
+    obj->remembered = false;
+    obj->gcIndex = gc_alloc_index();
+    gc_clear_marked(obj);
+
+    if (g_young != NULL) {
+        obj->next = g_young;
+        g_young->prev = obj;
+    }
+    g_young = obj;
+
+    // Objects created during a cycle survive it. While marking, they are grayed, since
+    // their references might be filled in after the roots were scanned. During the sweep
+    // they only need to be marked. Either way, the sweep cursor is already past them,
+    // because new objects are added at the front of the list.
+    if (gc_is_marking())
+        gc_mark(&g_gc.gray, obj, GCColor_Major);
+    else if (g_gc.phase == GCPhase_Sweep)
+        gc_set_marked(obj);
+}
 
-    if (g_first == NULL) {
-        g_first = obj;
-    } else {
-        obj->next = g_first;
-        g_first->prev = obj;
-        g_first = obj;
+static void gc_ref_list_remove(GCReferenceList* list, CircaObject* obj)
+{
+    for (int i=0; i < list->count; i++) {
+        if (list->refs[i] == obj) {
+            list->refs[i] = list->refs[list->count - 1];
+            list->count--;
+            return;
+        }
     }
 }
 
 void gc_on_object_deleted(CircaObject* obj)
 {
+    // Don't leave the collector holding a dangling pointer.
+    if (obj == g_gc.cursor)
+        g_gc.cursor = obj->next;
+    if (gc_is_marking())
+        gc_ref_list_remove(&g_gc.gray, obj);
+    if (obj->remembered) {
+        gc_ref_list_remove(&g_gc.remembered, obj);
+        obj->remembered = false;
+    }
+    if (obj->gcIndex != 0) {
+        gc_free_index(obj->gcIndex);
+        obj->gcIndex = 0;
+    }
+
     if (obj->next != NULL)
         obj->next->prev = obj->prev;
     if (obj->prev != NULL)
         obj->prev->next = obj->next;
 
-    // Check if 'obj' is the first object
+    // Check if 'obj' is the first object of either list
     if (obj == g_first)
         g_first = g_first->next;
+    else if (obj == g_young)
+        g_young = g_young->next;
 
     obj->next = NULL;
     obj->prev = NULL;
 }
 
-void gc_collect()
+static void gc_start_cycle()
 {
-    // Alternate the color on each pass.
-    char color = 1;
-    static char s_lastColorUsed = 0;
-    if (color == s_lastColorUsed)
-        color = 2;
-    s_lastColorUsed = color;
+    ca_assert(g_gc.phase == GCPhase_Idle);
+    ca_assert(g_gc.gray.count == 0);
 
-    g_currentlyCollecting = true;
+    memset(g_gc.markBits, 0, sizeof(unsigned) * g_gc.markBitsWords);
+    gc_ref_list_reserve(&g_gc.gray, gc_registered_count());
 
-    // First pass: find root objects, and accumulate their references.
-    GCReferenceList toMark;
-    for (CircaObject* current = g_first; current != NULL; current = current->next) {
-        if (current->root)
-            gc_mark(&toMark, current, color);
-    }
+    g_gc.phase = GCPhase_MarkRoots;
+    g_gc.cursor = g_young;
+    g_gc.cursorInOld = false;
+}
+
+// Called when the cursor reaches the end of a list. Moves it to the old list if it was
+// on the young list, otherwise returns false.
+static bool gc_cursor_next_list()
+{
+    if (g_gc.cursorInOld)
+        return false;
+
+    g_gc.cursorInOld = true;
+    g_gc.cursor = g_first;
+    return true;
+}
+
+// Blacken a gray object by graying everything that it references.
+static void gc_scan(CircaObject* object, GCColor color)
+{
+    gc_mark(&g_gc.gray, (CircaObject*) object->type, color);
 
-    // Mark everything else with a breadth-first search.
-    GCReferenceList currentlyMarking;
-    while (toMark.count > 0) {
+    if (object->type->gcListReferences != NULL)
+        object->type->gcListReferences(object, &g_gc.gray, color);
+}
 
-        gc_ref_list_swap(&toMark, &currentlyMarking);
-        gc_ref_list_reset(&toMark);
+static void gc_sweep_one(CircaObject* current)
+{
+    if (gc_is_marked(current))
+        return;
 
-        for (int i=0; i < currentlyMarking.count; i++) {
-            CircaObject* object = currentlyMarking.refs[i];
+    // Remove from linked list. This will nullify 'next' and 'prev'. The cursor has
+    // already moved on, and gets updated again if the release deletes more objects.
+    gc_on_object_deleted(current);
 
-            gc_mark(&toMark, object, color);
+    INCREMENT_STAT(GcObjectFreed);
+
+    // Release object
+    if (current->type->gcRelease != NULL)
+        current->type->gcRelease(current);
+}
+
+// Do up to 'units' objects worth of work on the current cycle. Returns true if the cycle
+// is finished.
+static bool gc_do_work(int units)
+{
+    while (units > 0) {
+        switch (g_gc.phase) {
+        case GCPhase_Idle:
+            return true;
+
+        case GCPhase_MarkRoots: {
+            CircaObject* current = g_gc.cursor;
+            if (current == NULL) {
+                if (!gc_cursor_next_list())
+                    g_gc.phase = GCPhase_Mark;
+                break;
+            }
+            g_gc.cursor = current->next;
+            if (current->root)
+                gc_mark(&g_gc.gray, current, GCColor_Major);
+            units--;
+            break;
+        }
+
+        case GCPhase_Mark: {
+            GCReferenceList* gray = &g_gc.gray;
+            if (gray->count == 0) {
+                g_gc.phase = GCPhase_Sweep;
+                g_gc.cursor = g_young;
+                g_gc.cursorInOld = false;
+                break;
+            }
+            CircaObject* object = gray->refs[--gray->count];
+            if (gray->count > 0)
+                GC_PREFETCH(gray->refs[gray->count - 1]);
+            gc_scan(object, GCColor_Major);
+            units--;
+            break;
+        }
+
+        case GCPhase_Sweep: {
+            CircaObject* current = g_gc.cursor;
+            if (current == NULL) {
+                if (gc_cursor_next_list())
+                    break;
+                g_gc.phase = GCPhase_Idle;
+                INCREMENT_STAT(GcCycle);
+                return true;
+            }
+            g_gc.cursor = current->next;
+            if (current->next != NULL)
+                GC_PREFETCH(current->next);
+            gc_sweep_one(current);
+            units--;
+            break;
+        }
         }
     }
 
-    // Last pass: delete unmarked objects.
-    for (CircaObject* current = g_first; current != NULL; ) {
+    return false;
+}
 
-        // Save 'next' pointer, in case the object is destroyed
-        CircaObject* next = current->next;
+static void gc_record_pause(uint64 micros)
+{
+#if CIRCA_ENABLE_PERF_STATS
+    PERF_STATS[stat_GcPauseMicros - c_firstStatIndex] += micros;
+    uint64* maxPause = &PERF_STATS[stat_GcMaxPauseMicros - c_firstStatIndex];
+    if (micros > *maxPause)
+        *maxPause = micros;
+#endif
+}
 
-        if (current->gcColor != color) {
+bool gc_step(int budgetMicros)
+{
+    INCREMENT_STAT(GcStep);
+
+    uint64 start = gc_now_micros();
+
+    if (g_gc.phase == GCPhase_Idle)
+        gc_start_cycle();
+
+    bool finished = false;
+    while (true) {
+        finished = gc_do_work(GCStepChunkSize);
+        if (finished)
+            break;
+        if (budgetMicros >= 0 && gc_now_micros() - start >= (uint64) budgetMicros)
+            break;
+    }
+
+    gc_record_pause(gc_now_micros() - start);
+    return finished;
+}
+
+bool gc_is_collecting()
+{
+    return g_gc.phase != GCPhase_Idle;
+}
+
+void gc_collect()
+{
+    if (g_gc.phase != GCPhase_Idle)
+        gc_step(-1);
+
+    gc_step(-1);
+}
+
+void gc_minor_collect()
+{
+    // A major cycle already covers the young objects.
+    if (g_gc.phase != GCPhase_Idle)
+        return;
+
+    INCREMENT_STAT(GcMinorCollect);
 
-            // Remove from linked list. This will nullify 'next' and 'prev'.
-            gc_on_object_deleted(current);
+    uint64 start = gc_now_micros();
+    GCReferenceList* gray = &g_gc.gray;
 
-            // Release object
-            if (current->type->gcRelease != NULL)
-                current->type->gcRelease(current);
+    // Only the young mark bits need to be cleared, old objects are never marked here.
+    int youngCount = 0;
+    for (CircaObject* current = g_young; current != NULL; current = current->next) {
+        gc_clear_marked(current);
+        youngCount++;
+    }
+    gc_ref_list_reserve(gray, youngCount);
+
+    // Roots are the young root objects, plus anything referenced by a remembered object.
+    // gc_mark ignores old objects when given GCColor_Minor, so marking stays inside the
+    // nursery.
+    for (CircaObject* current = g_young; current != NULL; current = current->next) {
+        if (current->root)
+            gc_mark(gray, current, GCColor_Minor);
+    }
+
+    for (int i=0; i < g_gc.remembered.count; i++)
+        gc_scan(g_gc.remembered.refs[i], GCColor_Minor);
+
+    while (gray->count > 0) {
+        CircaObject* object = gray->refs[--gray->count];
+        if (gray->count > 0)
+            GC_PREFETCH(gray->refs[gray->count - 1]);
+        gc_scan(object, GCColor_Minor);
+    }
+
+    // Sweep the young list.
+    g_gc.cursor = g_young;
+    g_gc.cursorInOld = false;
+    while (g_gc.cursor != NULL) {
+        CircaObject* current = g_gc.cursor;
+        g_gc.cursor = current->next;
+        gc_sweep_one(current);
+    }
+
+    // Promote the survivors by moving the whole young list to the front of the old list.
+    if (g_young != NULL) {
+        CircaObject* last = NULL;
+        for (CircaObject* current = g_young; current != NULL; current = current->next) {
+            current->young = false;
+            last = current;
+#if CIRCA_ENABLE_PERF_STATS
+            PERF_STATS[stat_GcPromoted - c_firstStatIndex]++;
+#endif
         }
 
-        current = next;
+        last->next = g_first;
+        if (g_first != NULL)
+            g_first->prev = last;
+        g_first = g_young;
+        g_young = NULL;
     }
-    
-    g_currentlyCollecting = false;
+
+    // Nothing is young anymore, so no old object can reference a young one.
+    for (int i=0; i < g_gc.remembered.count; i++)
+        g_gc.remembered.refs[i]->remembered = false;
+    gc_ref_list_reset(&g_gc.remembered);
+
+    gc_record_pause(gc_now_micros() - start);
 }
 
 void gc_ref_list_reset(GCReferenceList* list)
@@ -103,28 +441,75 @@ void gc_ref_list_reset(GCReferenceList* list)
     list->count = 0;
 }
 
-int gc_count_live_objects()
+void gc_ref_list_reserve(GCReferenceList* list, int capacity)
+{
+    if (capacity <= list->capacity)
+        return;
+
+    list->capacity = capacity;
+    list->refs = (CircaObject**) realloc(list->refs, sizeof(CircaObject*) * list->capacity);
+}
+
+void gc_ref_list_append(GCReferenceList* list, CircaObject* object)
+{
+    if (list->count >= list->capacity)
+        gc_ref_list_reserve(list, list->capacity < 16 ? 16 : list->capacity * 2);
+    list->refs[list->count++] = object;
+}
+
+static int gc_count_list(CircaObject* first)
 {
     int count = 0;
-    for (CircaObject* current = g_first; current != NULL; current = current->next)
+    for (CircaObject* current = first; current != NULL; current = current->next)
         count += 1;
     return count;
 }
 
+int gc_count_live_objects()
+{
+    return gc_count_list(g_first) + gc_count_list(g_young);
+}
+
+int gc_count_young_objects()
+{
+    return gc_count_list(g_young);
+}
+
 void gc_dump_live_objects()
 {
-    for (CircaObject* current = g_first; current != NULL; current = current->next) {
-        std::cout << as_cstring(&current->type->name)
-            << "@" << current << std::endl;
+    CircaObject* lists[] = { g_first, g_young };
+    for (int i=0; i < 2; i++) {
+        for (CircaObject* current = lists[i]; current != NULL; current = current->next) {
+            std::cout << as_cstring(&current->type->name)
+                << "@" << current << (current->young ? " (young)" : "") << std::endl;
+        }
+    }
+}
+
+void gc_list_live_objects(GCReferenceList* out)
+{
+    gc_ref_list_reset(out);
+    CircaObject* lists[] = { g_first, g_young };
+    for (int i=0; i < 2; i++) {
+        for (CircaObject* current = lists[i]; current != NULL; current = current->next)
+            gc_ref_list_append(out, current);
     }
 }
 
 bool gc_sanity_check_live_objects()
 {
-    for (CircaObject* current = g_first; current != NULL; current = current->next) {
-        if (strcmp(current->magicalHeader, "caobj") != 0) {
-            std::cout << "sanity check failed on live object:" << std::endl;
-            return false;
+    CircaObject* lists[] = { g_first, g_young };
+    for (int i=0; i < 2; i++) {
+        for (CircaObject* current = lists[i]; current != NULL; current = current->next) {
+            if (strcmp(current->magicalHeader, "caobj") != 0) {
+                std::cout << "sanity check failed on live object:" << std::endl;
+                return false;
+            }
+            if (current->young != (i == 1)) {
+                std::cout << "sanity check failed, object is on the wrong generation list"
+                    << std::endl;
+                return false;
+            }
         }
     }
     return true;
@@ -135,22 +520,21 @@ void gc_mark(GCReferenceList* refList, CircaObject* object, GCColor color)
     if (object == NULL)
         return;
 
+#if CIRCA_ENABLE_GC_HEADER_CHECKS
     if (strcmp(object->magicalHeader, "caobj") != 0)
         internal_error("called gc_mark on not a CircaObject");
-    
-    if (object->gcColor == color)
-        return;
+#endif
 
-    object->gcColor = color;
+    // A minor collection only marks young objects.
+    if (color == GCColor_Minor && !object->young)
+        return;
 
-    gc_mark(refList, (CircaObject*) object->type, color);
+    if (gc_is_marked(object))
+        return;
 
-    if (object->type->gcListReferences != NULL)
-        object->type->gcListReferences(object, refList, color);
+    gc_set_marked(object);
 
-    refList->count += 1;
-    refList->refs = (CircaObject**) realloc(refList->refs, sizeof(CircaObject*) * refList->count);
-    refList->refs[refList->count - 1] = object;
+    gc_ref_list_append(refList, object);
 }
 
 void gc_mark_tagged_value(GCReferenceList* list, caValue* value, GCColor color)
@@ -164,12 +548,12 @@ void gc_mark_tagged_value(GCReferenceList* list, caValue* value, GCColor color)
 
 void gc_ref_list_swap(GCReferenceList* a, GCReferenceList* b)
 {
-    int tempCount = a->count;
-    CircaObject** tempRefs = a->refs;
-    a->count = b->count;
-    a->refs = b->refs;
-    b->count = tempCount;
-    b->refs = tempRefs;
+    GCReferenceList temp = *a;
+    *a = *b;
+    *b = temp;
+
+    // Don't let the destructor of 'temp' free the swapped array.
+    temp.refs = NULL;
 }
 
 void gc_register_new_object(CircaObject* obj, Type* type, bool isRoot)
@@ -185,7 +569,7 @@ void gc_register_new_object(CircaObject* obj, Type* type, bool isRoot)
     obj->prev = NULL;
     obj->root = isRoot;
     obj->referenced = false;
-    obj->gcColor = 0;
+    obj->gcIndex = 0;
 
     gc_register_object(header);
     
@@ -199,14 +583,33 @@ void on_object_deleted(CircaObject* obj)
     gc_on_object_deleted(obj);
 }
 
+void gc_write_barrier(CircaObject* container, CircaObject* obj)
+{
+    if (obj == NULL)
+        return;
+
+    if (gc_is_marking())
+        gc_mark(&g_gc.gray, obj, GCColor_Major);
+
+    if (obj->young && container != NULL && !container->young && !container->remembered) {
+        container->remembered = true;
+        gc_ref_list_append(&g_gc.remembered, container);
+    }
+}
+
 void gc_set_object_is_root(CircaObject* obj, bool root)
 {
     obj->root = root;
+
+    // The roots may have been scanned already. Whoever holds this object now has to
+    // keep it reachable, so treat that the same as storing a new reference.
+    gc_write_barrier(NULL, obj);
 }
 
 void gc_mark_object_referenced(CircaObject* obj)
 {
     obj->referenced = true;
+    gc_write_barrier(NULL, obj);
 }
 
 } // namespace circa
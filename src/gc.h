@@ -8,13 +8,40 @@
 
 namespace circa {
 
+// Garbage collection
+//
+// The collector is an incremental tri-color mark and sweep. An object is white if its
+// mark bit is clear, gray if its mark bit is set and it's waiting on the mark stack, and
+// black once its references have been scanned. Mark bits are kept in a side bitmap,
+// indexed by CircaObject.gcIndex, so that starting a collection only needs to clear the
+// bitmap and doesn't touch the objects.
+//
+// A cycle goes through these phases, and gc_step() does a bounded amount of work on
+// whichever phase is current:
+//
+//   MarkRoots - Walk the object lists and gray every root object.
+//   Mark      - Pop gray objects and gray everything they reference.
+//   Sweep     - Walk the object lists and release every object that's still white.
+//
+// Since the program keeps running between steps, references that are stored during
+// marking must be reported with gc_write_barrier(), otherwise an object that's only
+// reachable from an already-black object would be swept. Objects that are created
+// during a cycle are grayed right away, so they always survive the cycle.
+//
+// New objects go on a separate young list (the nursery). gc_minor_collect() only walks
+// that list: it marks from the young roots and from the remembered set, releases the
+// young objects that weren't reached, and promotes the rest to the old list. The
+// remembered set holds old objects that had a reference to a young object stored in
+// them, which gc_write_barrier() also keeps track of.
+
 // Structure used during GC traversal
 struct GCReferenceList
 {
     int count;
+    int capacity;
     CircaObject** refs;
 
-    GCReferenceList() : count(0), refs(NULL) {}
+    GCReferenceList() : count(0), capacity(0), refs(NULL) {}
     ~GCReferenceList() { free(refs); }
 };
 
@@ -22,8 +49,23 @@ struct GCReferenceList
 // this object outside of garbage collection, they should call this.
 void gc_on_object_deleted(CircaObject* obj);
 
+// Run a full collection. If an incremental cycle is in progress, it's finished first,
+// then a fresh cycle is run so that garbage created during the old cycle is released.
 void gc_collect();
 
+// Do up to 'budgetMicros' microseconds of collection work, starting a new cycle if none
+// is in progress. Each call makes some progress even if the budget is tiny. A negative
+// budget means no limit. Returns true if this call finished a cycle.
+bool gc_step(int budgetMicros);
+
+// Whether an incremental cycle has been started and not finished yet.
+bool gc_is_collecting();
+
+// Collect the young generation, and promote every young object that survives. Does
+// nothing while an incremental cycle is in progress, since that cycle covers the young
+// objects too.
+void gc_minor_collect();
+
 // Add object to the global list. Should call this on object creation.
 void gc_register_object(CircaObject* object);
 
@@ -32,11 +74,15 @@ void gc_mark(GCReferenceList* list, CircaObject* item, GCColor color);
 void gc_mark_tagged_value(GCReferenceList* list, caValue* value, GCColor color);
 
 void gc_ref_list_reset(GCReferenceList* list);
+void gc_ref_list_reserve(GCReferenceList* list, int capacity);
+void gc_ref_list_append(GCReferenceList* list, CircaObject* object);
 
 // Query the live object list
 int gc_count_live_objects();
+int gc_count_young_objects();
 bool gc_sanity_check_live_objects();
 void gc_dump_live_objects();
+void gc_list_live_objects(GCReferenceList* out);
 
 // Swap the contents of 'a' with 'b'
 void gc_ref_list_swap(GCReferenceList* a, GCReferenceList* b);
@@ -46,4 +92,9 @@ void gc_on_object_deleted(CircaObject* obj);
 void gc_set_object_is_root(CircaObject* obj, bool root);
 void gc_mark_object_referenced(CircaObject* obj);
 
+// Write barrier. Call this when a reference to 'obj' is stored into the GC object
+// 'container' (for example, when a Term in a Block gets a new type). 'container' may be
+// NULL if the reference is held somewhere that the collector doesn't trace.
+void gc_write_barrier(CircaObject* container, CircaObject* obj);
+
 } // namespace circa
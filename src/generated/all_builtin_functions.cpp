@@ -26,6 +26,7 @@
 #include "../functions/input_explicit.cpp"
 #include "../functions/internal_debug.cpp"
 #include "../functions/list.cpp"
+#include "../functions/list_math.cpp"
 #include "../functions/logical.cpp"
 #include "../functions/make.cpp"
 #include "../functions/math.cpp"
@@ -1,5 +1,6 @@
 #include "../block.cpp"
 #include "../building.cpp"
+#include "../bytecode.cpp"
 #include "../c_api.cpp"
 #include "../closures.cpp"
 #include "../code_iterators.cpp"
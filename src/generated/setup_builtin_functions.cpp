@@ -38,6 +38,7 @@ namespace increment_function { void setup(Block* kernel); }
 namespace input_explicit_function { void setup(Block* kernel); }
 namespace internal_debug_function { void setup(Block* kernel); }
 namespace list_function { void setup(Block* kernel); }
+namespace list_math_function { void setup(Block* kernel); }
 namespace logical_function { void setup(Block* kernel); }
 namespace make_function { void setup(Block* kernel); }
 namespace math_function { void setup(Block* kernel); }
@@ -96,6 +97,7 @@ void setup_builtin_functions(Block* kernel)
     input_explicit_function::setup(kernel);
     internal_debug_function::setup(kernel);
     list_function::setup(kernel);
+    list_math_function::setup(kernel);
     logical_function::setup(kernel);
     make_function::setup(kernel);
     math_function::setup(kernel);
@@ -94,6 +94,10 @@ const char* STDLIB_CA_TEXT =
     "    def module_search_paths() -> List\n"
     "    def perf_stats_reset()\n"
     "    def perf_stats_dump() -> List\n"
+    "    def time() -> number\n"
+    "        -- Seconds elapsed since the first call to sys:time().\n"
+    "    def peak_memory() -> int\n"
+    "        -- Peak resident memory used by this process, in kilobytes.\n"
     "\n"
     "-- Metaprogramming on Block\n"
     "def block_ref(any block :ignore_error) -> Block\n"
@@ -332,7 +336,6 @@ const char* STDLIB_CA_TEXT =
     "\n"
     "def String.append(@self, String right)\n"
     "    -- Modify 'self' by appending the given string on the right side.\n"
-    "    self = concat(self, right)\n"
     "    \n"
     "def String.char_at(self, int index) -> String\n"
     "\n"
@@ -521,12 +524,6 @@ const char* STDLIB_CA_TEXT =
     "def Rect.contains(self, Point p) -> bool\n"
     "    p.x >= self.x1 and p.y >= self.y1 and p.x < self.x2 and p.y < self.y2\n"
     "\n"
-    "def sum(List numbers) -> number\n"
-    "    result = 0\n"
-    "    for i in numbers\n"
-    "        result += i\n"
-    "    result\n"
-    "    \n"
     "\n"
     "def zip(List left, List right) -> List\n"
     "    for l in left\n"
@@ -8,243 +8,424 @@
 
 namespace circa {
 
+// Map values are stored as a persistent hash array mapped trie. Each level of the trie
+// uses BitsPerLevel bits of the key's hash to pick one of 32 positions. A position either
+// holds a key/value pair directly (its bit is set in 'dataMap'), or holds a child node
+// (its bit is set in 'nodeMap'). Pairs and children are stored compactly in bit order,
+// so a position's index is the number of lower bits that are set.
+//
+// Nodes are refcounted, and copying a Map just shares the root node. Modifying a table
+// makes a private copy of each shared node on the path to the key, so an update is
+// O(log32 n) no matter how many copies of the table exist. Nodes that aren't shared are
+// modified in place.
+//
+// Once all the hash bits are used up, keys with the same hash are kept in a collision
+// node, which is a plain array of pairs.
+
 struct Slot {
     caValue key;
     caValue value;
 };
 
+struct HashtableNode {
+    int refCount;
+
+    unsigned dataMap;
+    unsigned nodeMap;
+
+    int pairCount;
+    int childCount;
+
+    Slot pairs[0];
+    // pairs has size [pairCount], and is followed by [childCount] child pointers.
+};
+
 struct Hashtable {
-    int capacity;
     int count;
-    Slot slots[0];
-    // slots has size [capacity].
+    HashtableNode* root;
 };
 
-int hashtable_insert(Hashtable** dataPtr, caValue* key, bool consumeKey);
-int hashtable_find_slot(Hashtable* data, caValue* key);
-caValue* hashtable_get(Hashtable* data, caValue* key);
+const int BitsPerLevel = 5;
+const unsigned LevelMask = (1 << BitsPerLevel) - 1;
 
-// How many slots to create for a brand new table.
-const int INITIAL_SIZE = 10;
+// Nodes at this shift (or deeper) have no hash bits left, and are collision nodes.
+const int CollisionShift = 35;
 
-// When reallocating a table, how many slots should initially be filled.
-const float INITIAL_LOAD_FACTOR = 0.3f;
+static int bit_count(unsigned bits)
+{
+#ifdef __GNUC__
+    return __builtin_popcount(bits);
+#else
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1)
+        count++;
+    return count;
+#endif
+}
 
-// The load at which we'll trigger a reallocation.
-const float MAX_LOAD_FACTOR = 0.75f;
+static HashtableNode** node_children(HashtableNode* node)
+{
+    return (HashtableNode**) &node->pairs[node->pairCount];
+}
 
-Hashtable* create_table(int capacity)
+static unsigned hash_bit(unsigned hash, int shift)
 {
-    ca_assert(capacity > 0);
-    Hashtable* result = (Hashtable*) malloc(sizeof(Hashtable) + capacity * sizeof(Slot));
-    result->capacity = capacity;
-    result->count = 0;
-    memset(result->slots, 0, capacity * sizeof(Slot));
-    for (int s=0; s < capacity; s++) {
-        initialize_null(&result->slots[s].key);
-        initialize_null(&result->slots[s].value);
+    return 1u << ((hash >> shift) & LevelMask);
+}
+
+// Index of the entry for 'bit', among the entries that have a bit set in 'map'.
+static int bit_index(unsigned map, unsigned bit)
+{
+    return bit_count(map & (bit - 1));
+}
+
+static HashtableNode* node_create(int pairCount, int childCount)
+{
+    HashtableNode* node = (HashtableNode*) malloc(sizeof(HashtableNode)
+        + pairCount * sizeof(Slot) + childCount * sizeof(HashtableNode*));
+    node->refCount = 1;
+    node->dataMap = 0;
+    node->nodeMap = 0;
+    node->pairCount = pairCount;
+    node->childCount = childCount;
+    for (int i=0; i < pairCount; i++) {
+        initialize_null(&node->pairs[i].key);
+        initialize_null(&node->pairs[i].value);
     }
-    return result;
+    memset(node_children(node), 0, childCount * sizeof(HashtableNode*));
+    return node;
 }
 
-Hashtable* create_table()
+static void node_incref(HashtableNode* node)
 {
-    return create_table(INITIAL_SIZE);
+    node->refCount++;
 }
 
-void free_table(Hashtable* data)
+static void node_decref(HashtableNode* node)
 {
-    if (data == NULL)
+    if (node == NULL)
+        return;
+
+    ca_assert(node->refCount > 0);
+    node->refCount--;
+    if (node->refCount > 0)
         return;
 
-    for (int i=0; i < data->capacity; i++) {
-        set_null(&data->slots[i].key);
-        set_null(&data->slots[i].value);
+    for (int i=0; i < node->pairCount; i++) {
+        set_null(&node->pairs[i].key);
+        set_null(&node->pairs[i].value);
     }
-    free(data);
+    HashtableNode** children = node_children(node);
+    for (int i=0; i < node->childCount; i++)
+        node_decref(children[i]);
+    free(node);
 }
 
-Hashtable* grow(Hashtable* data, int new_capacity)
+// Make sure that *nodePtr isn't shared with any other table, copying it if needed.
+static void node_touch(HashtableNode** nodePtr)
 {
-    Hashtable* new_data = create_table(new_capacity);
+    HashtableNode* node = *nodePtr;
+    if (node->refCount == 1)
+        return;
 
-    int existingCapacity = 0;
-    if (data != NULL)
-        existingCapacity = data->capacity;
+    INCREMENT_STAT(HashtableNodeCopy);
 
-    // Move all the keys & values over.
-    for (int i=0; i < existingCapacity; i++) {
-        Slot* old_slot = &data->slots[i];
+    HashtableNode* dupe = node_create(node->pairCount, node->childCount);
+    dupe->dataMap = node->dataMap;
+    dupe->nodeMap = node->nodeMap;
+    for (int i=0; i < node->pairCount; i++) {
+        copy(&node->pairs[i].key, &dupe->pairs[i].key);
+        copy(&node->pairs[i].value, &dupe->pairs[i].value);
+    }
+    HashtableNode** children = node_children(node);
+    HashtableNode** dupeChildren = node_children(dupe);
+    for (int i=0; i < node->childCount; i++) {
+        dupeChildren[i] = children[i];
+        node_incref(children[i]);
+    }
 
-        if (is_null(&old_slot->key))
+    node_decref(node);
+    *nodePtr = dupe;
+}
+
+// Rebuild an unshared node with a different number of pairs and children. Entries are
+// moved over in order. The pair at 'removePair' and the child at 'removeChild' are
+// dropped, and an empty entry is left at 'insertPair' and 'insertChild' (which are
+// indexes in the new node). Pass -1 to leave out any of these. The old node's removed
+// entries must already be cleared.
+static HashtableNode* node_reshape(HashtableNode* node, int removePair, int insertPair,
+    int removeChild, int insertChild)
+{
+    ca_assert(node->refCount == 1);
+
+    int pairCount = node->pairCount + (insertPair != -1) - (removePair != -1);
+    int childCount = node->childCount + (insertChild != -1) - (removeChild != -1);
+    HashtableNode* result = node_create(pairCount, childCount);
+    result->dataMap = node->dataMap;
+    result->nodeMap = node->nodeMap;
+
+    int dest = 0;
+    for (int i=0; i < node->pairCount; i++) {
+        if (i == removePair)
             continue;
+        if (dest == insertPair)
+            dest++;
+        move(&node->pairs[i].key, &result->pairs[dest].key);
+        move(&node->pairs[i].value, &result->pairs[dest].value);
+        dest++;
+    }
 
-        int index = hashtable_insert(&new_data, &old_slot->key, true);
-        swap(&old_slot->value, &new_data->slots[index].value);
+    HashtableNode** children = node_children(node);
+    HashtableNode** resultChildren = node_children(result);
+    dest = 0;
+    for (int i=0; i < node->childCount; i++) {
+        if (i == removeChild)
+            continue;
+        if (dest == insertChild)
+            dest++;
+        resultChildren[dest++] = children[i];
     }
-    return new_data;
+
+    // Everything was moved, so the old node only needs its memory freed.
+    free(node);
+    return result;
 }
 
-// Grow this dictionary by the default growth rate. This will result in a new Hashtable*
-// object, don't use the old one after calling this.
-void grow(Hashtable** dataPtr)
+static void node_move_pair(Slot* source, Slot* dest)
 {
-    int new_capacity = int((*dataPtr)->count / INITIAL_LOAD_FACTOR);
-    Hashtable* oldData = *dataPtr;
-    *dataPtr = grow(*dataPtr, new_capacity);
-    free_table(oldData);
+    move(&source->key, &dest->key);
+    move(&source->value, &dest->value);
 }
 
-Hashtable* duplicate(Hashtable* original)
+static caValue* node_find(HashtableNode* node, caValue* key, unsigned hash)
 {
-    if (original == NULL)
-        return NULL;
-
-    int new_capacity = int(original->count / INITIAL_LOAD_FACTOR);
-    if (new_capacity < INITIAL_SIZE)
-        new_capacity = INITIAL_SIZE;
+    for (int shift=0; node != NULL; shift += BitsPerLevel) {
+        if (shift >= CollisionShift) {
+            for (int i=0; i < node->pairCount; i++)
+                if (equals(&node->pairs[i].key, key))
+                    return &node->pairs[i].value;
+            return NULL;
+        }
 
-    Hashtable* dupe = create_table(new_capacity);
+        unsigned bit = hash_bit(hash, shift);
 
-    // Copy all items
-    for (int i=0; i < original->capacity; i++) {
-        Slot* slot = &original->slots[i];
+        if (node->dataMap & bit) {
+            Slot* pair = &node->pairs[bit_index(node->dataMap, bit)];
+            if (equals(&pair->key, key))
+                return &pair->value;
+            return NULL;
+        }
 
-        if (is_null(&slot->key))
-            continue;
+        if (!(node->nodeMap & bit))
+            return NULL;
 
-        int index = hashtable_insert(&dupe, &slot->key, false);
-        copy(&slot->value, &dupe->slots[index].value);
+        node = node_children(node)[bit_index(node->nodeMap, bit)];
     }
-    return dupe;
+    return NULL;
 }
 
-// Get the 'ideal' slot index, the place we would put this key if there is no
-// collision.
-int find_ideal_slot_index(Hashtable* data, caValue* key)
+// Find or insert 'key' in the subtree at *nodePtr, and return its value slot. Every node
+// on the path is made unshared, so the caller can write to the returned slot.
+static caValue* node_insert(HashtableNode** nodePtr, caValue* key, unsigned hash,
+    int shift, bool consumeKey, bool* added)
 {
-    ca_assert(data->capacity > 0);
-    unsigned int hash = get_hash_value(key);
-    return int(hash % data->capacity);
-}
+    node_touch(nodePtr);
+    HashtableNode* node = *nodePtr;
+
+    if (shift >= CollisionShift) {
+        for (int i=0; i < node->pairCount; i++)
+            if (equals(&node->pairs[i].key, key))
+                return &node->pairs[i].value;
+
+        node = node_reshape(node, -1, node->pairCount, -1, -1);
+        *nodePtr = node;
+        Slot* pair = &node->pairs[node->pairCount - 1];
+        if (consumeKey)
+            swap(key, &pair->key);
+        else
+            copy(key, &pair->key);
+        *added = true;
+        return &pair->value;
+    }
 
-// Insert the given key into the dictionary, returns the index.
-// This may create a new Hashtable* object, so don't use the old Hashtable* pointer after
-// calling this.
-int hashtable_insert(Hashtable** dataPtr, caValue* key, bool consumeKey)
-{
-    if (*dataPtr == NULL)
-        *dataPtr = create_table();
+    unsigned bit = hash_bit(hash, shift);
 
-    // Check if this key is already here
-    int existing = hashtable_find_slot(*dataPtr, key);
-    if (existing != -1)
-        return existing;
+    if (node->nodeMap & bit) {
+        HashtableNode** child = &node_children(node)[bit_index(node->nodeMap, bit)];
+        return node_insert(child, key, hash, shift + BitsPerLevel, consumeKey, added);
+    }
 
-    // Check if it is time to reallocate
-    if ((*dataPtr)->count >= MAX_LOAD_FACTOR * ((*dataPtr)->capacity))
-        grow(dataPtr);
+    if (node->dataMap & bit) {
+        int pairIndex = bit_index(node->dataMap, bit);
+        Slot* existing = &node->pairs[pairIndex];
+        if (equals(&existing->key, key))
+            return &existing->value;
+
+        // Two keys share this position, so push the existing pair down into a new child
+        // node, and insert the new key there.
+        int childShift = shift + BitsPerLevel;
+        HashtableNode* child = node_create(1, 0);
+        if (childShift < CollisionShift)
+            child->dataMap = hash_bit(get_hash_value(&existing->key), childShift);
+        node_move_pair(existing, &child->pairs[0]);
+
+        node->dataMap &= ~bit;
+        node->nodeMap |= bit;
+        node = node_reshape(node, pairIndex, -1, -1, bit_index(node->nodeMap, bit));
+        *nodePtr = node;
+
+        HashtableNode** childPtr = &node_children(node)[bit_index(node->nodeMap, bit)];
+        *childPtr = child;
+        return node_insert(childPtr, key, hash, childShift, consumeKey, added);
+    }
 
-    Hashtable* data = *dataPtr;
-    int index = find_ideal_slot_index(data, key);
+    // Empty position.
+    node->dataMap |= bit;
+    int pairIndex = bit_index(node->dataMap, bit);
+    node = node_reshape(node, -1, pairIndex, -1, -1);
+    *nodePtr = node;
 
-    // Linearly advance if this slot is being used
-    int starting_index = index;
-    while (!is_null(&data->slots[index].key)) {
-        index = (index + 1) % data->capacity;
+    Slot* pair = &node->pairs[pairIndex];
+    if (consumeKey)
+        swap(key, &pair->key);
+    else
+        copy(key, &pair->key);
+    *added = true;
+    return &pair->value;
+}
 
-        // Die if we made it all the way around
-        if (index == starting_index) {
-            ca_assert(false);
-            return 0;
+// Remove 'key' from the subtree at *nodePtr. The key must be present.
+static void node_remove(HashtableNode** nodePtr, caValue* key, unsigned hash, int shift)
+{
+    node_touch(nodePtr);
+    HashtableNode* node = *nodePtr;
+
+    if (shift >= CollisionShift) {
+        for (int i=0; i < node->pairCount; i++) {
+            if (equals(&node->pairs[i].key, key)) {
+                set_null(&node->pairs[i].key);
+                set_null(&node->pairs[i].value);
+                *nodePtr = node_reshape(node, i, -1, -1, -1);
+                return;
+            }
         }
+        internal_error("node_remove: key not found");
     }
 
-    Slot* slot = &data->slots[index];
+    unsigned bit = hash_bit(hash, shift);
 
-    if (consumeKey)
-        swap(key, &slot->key);
-    else
-        copy(key, &slot->key);
+    if (node->dataMap & bit) {
+        int pairIndex = bit_index(node->dataMap, bit);
+        set_null(&node->pairs[pairIndex].key);
+        set_null(&node->pairs[pairIndex].value);
+        node->dataMap &= ~bit;
+        *nodePtr = node_reshape(node, pairIndex, -1, -1, -1);
+        return;
+    }
 
-    data->count++;
+    ca_assert(node->nodeMap & bit);
+    int childIndex = bit_index(node->nodeMap, bit);
+    HashtableNode** childPtr = &node_children(node)[childIndex];
+    node_remove(childPtr, key, hash, shift + BitsPerLevel);
+
+    // If the child is left with a single pair, pull it up into this node, so that the
+    // trie doesn't keep chains of nearly empty nodes.
+    HashtableNode* child = *childPtr;
+    if (child->childCount == 0 && child->pairCount <= 1) {
+        node->nodeMap &= ~bit;
+        if (child->pairCount == 1) {
+            node->dataMap |= bit;
+            int pairIndex = bit_index(node->dataMap, bit);
+            node = node_reshape(node, -1, pairIndex, childIndex, -1);
+            node_move_pair(&child->pairs[0], &node->pairs[pairIndex]);
+        } else {
+            node = node_reshape(node, -1, -1, childIndex, -1);
+        }
+        node_decref(child);
+        *nodePtr = node;
+    }
+}
 
-    return index;
+static void node_to_string(HashtableNode* node, std::stringstream& strm, bool* first)
+{
+    for (int i=0; i < node->pairCount; i++) {
+        if (!*first)
+            strm << ", ";
+        *first = false;
+
+        strm << circa::to_string(&node->pairs[i].key);
+        strm << ": " << circa::to_string(&node->pairs[i].value);
+    }
+
+    HashtableNode** children = node_children(node);
+    for (int i=0; i < node->childCount; i++)
+        node_to_string(children[i], strm, first);
 }
 
-void insert_value(Hashtable** dataPtr, caValue* key, caValue* value)
+Hashtable* create_table()
 {
-    int index = hashtable_insert(dataPtr, key, false);
-    copy(value, &(*dataPtr)->slots[index].value);
+    Hashtable* result = (Hashtable*) malloc(sizeof(Hashtable));
+    result->count = 0;
+    result->root = node_create(0, 0);
+    return result;
 }
 
-int hashtable_find_slot(Hashtable* data, caValue* key)
+void free_table(Hashtable* data)
 {
     if (data == NULL)
-        return -1;
+        return;
 
-    int index = find_ideal_slot_index(data, key);
-    int starting_index = index;
-    while (!equals(key, &data->slots[index].key)) {
-        index = (index + 1) % data->capacity;
+    node_decref(data->root);
+    free(data);
+}
 
-        // If we hit an empty slot, then give up.
-        if (is_null(&data->slots[index].key))
-            return -1;
+// Copying a table shares all of its nodes.
+Hashtable* duplicate(Hashtable* original)
+{
+    if (original == NULL)
+        return NULL;
 
-        // Or, if we looped around to the starting index, give up.
-        if (index == starting_index)
-            return -1;
-    }
+    INCREMENT_STAT(HashtableSoftCopy);
 
-    return index;
+    Hashtable* dupe = (Hashtable*) malloc(sizeof(Hashtable));
+    dupe->count = original->count;
+    dupe->root = original->root;
+    node_incref(dupe->root);
+    return dupe;
 }
 
-caValue* hashtable_get(Hashtable* data, caValue* key)
+// Find or insert the given key, and return its value slot. The returned slot is not
+// shared with any other table.
+caValue* hashtable_insert(Hashtable** dataPtr, caValue* key, bool consumeKey)
 {
-    int index = hashtable_find_slot(data, key);
-    if (index == -1) return NULL;
-    return &data->slots[index].value;
+    if (*dataPtr == NULL)
+        *dataPtr = create_table();
+
+    Hashtable* data = *dataPtr;
+    bool added = false;
+    caValue* slot = node_insert(&data->root, key, get_hash_value(key), 0, consumeKey,
+        &added);
+    if (added)
+        data->count++;
+    return slot;
 }
 
-caValue* get_index(Hashtable* data, int index)
+caValue* hashtable_get(Hashtable* data, caValue* key)
 {
-    ca_assert(index < data->capacity);
-    return &data->slots[index].value;
+    if (data == NULL)
+        return NULL;
+
+    return node_find(data->root, key, get_hash_value(key));
 }
 
 void remove(Hashtable* data, caValue* key)
 {
-    int index = hashtable_find_slot(data, key);
-    if (index == -1)
+    // Check first, so that removing a missing key doesn't copy any shared nodes.
+    if (hashtable_get(data, key) == NULL)
         return;
 
-    // Clear out this slot
-    set_null(&data->slots[index].key);
-    set_null(&data->slots[index].value);
+    node_remove(&data->root, key, get_hash_value(key), 0);
     data->count--;
-
-    // Check if any following keys would prefer to be moved up to this empty slot.
-    while (true) {
-        int prevIndex = index;
-        index = (index+1) % data->capacity;
-
-        Slot* slot = &data->slots[index];
-
-        if (is_null(&slot->key))
-            break;
-
-        // If a slot isn't in its ideal index, then we assume that it would rather be in
-        // this slot.
-        if (find_ideal_slot_index(data, &slot->key) != index) {
-            Slot* prevSlot = &data->slots[prevIndex];
-            move(&slot->key, &prevSlot->key);
-            move(&slot->value, &prevSlot->value);
-            continue;
-        }
-
-        break;
-    }
 }
 
 int count(Hashtable* data)
@@ -254,13 +435,8 @@ int count(Hashtable* data)
 
 void clear(Hashtable* data)
 {
-    for (int i=0; i < data->capacity; i++) {
-        Slot* slot = &data->slots[i];
-        if (is_null(&slot->key))
-            continue;
-        set_null(&slot->key);
-        set_null(&slot->value);
-    }
+    node_decref(data->root);
+    data->root = node_create(0, 0);
     data->count = 0;
 }
 
@@ -268,31 +444,31 @@ std::string to_string(Hashtable* data)
 {
     std::stringstream strm;
     strm << "{";
-    int count = data == NULL ? 0 : data->capacity;
     bool first = true;
-    for (int i=0; i < count; i++) {
-        if (is_null(&data->slots[i].key))
-            continue;
-
-        if (!first)
-            strm << ", ";
-        first = false;
-
-        strm << circa::to_string(&data->slots[i].key);
-        strm << ": " << circa::to_string(&data->slots[i].value);
-    }
+    if (data != NULL)
+        node_to_string(data->root, strm, &first);
     strm << "}";
     return strm.str();
 }
 
+static void node_debug_print(HashtableNode* node, int depth)
+{
+    printf("%*snode %p refCount: %d, dataMap: %08x, nodeMap: %08x\n", depth * 2, "",
+        node, node->refCount, node->dataMap, node->nodeMap);
+    for (int i=0; i < node->pairCount; i++)
+        printf("%*s%s = %s\n", depth * 2 + 2, "",
+            circa::to_string(&node->pairs[i].key).c_str(),
+            circa::to_string(&node->pairs[i].value).c_str());
+    HashtableNode** children = node_children(node);
+    for (int i=0; i < node->childCount; i++)
+        node_debug_print(children[i], depth + 1);
+}
+
 void debug_print(Hashtable* data)
 {
-    printf("dict: %p\n", data);
-    printf("count: %d, capacity: %d\n", data->count, data->capacity);
-    for (int i=0; i < data->capacity; i++) {
-        printf("[%d] %s = %s\n", i, circa::to_string(&data->slots[i].key).c_str(),
-                circa::to_string(&data->slots[i].value).c_str());
-    }
+    printf("hashtable: %p\n", data);
+    printf("count: %d\n", data->count);
+    node_debug_print(data->root, 0);
 }
 
 namespace tagged_value_wrappers {
@@ -343,10 +519,7 @@ caValue* hashtable_insert(caValue* tableTv, caValue* key, bool consumeKey)
 {
     ca_assert(is_hashtable(tableTv));
     Hashtable*& table = (Hashtable*&) tableTv->value_data.ptr;
-    int index = hashtable_insert(&table, key, consumeKey);
-
-    caValue* slot = &table->slots[index].value;
-    return slot;
+    return hashtable_insert(&table, key, consumeKey);
 }
 
 caValue* hashtable_insert(caValue* table, caValue* key)
@@ -5,6 +5,11 @@
 #include "circa/circa.h"
 #include "circa/file.h"
 
+#ifndef _MSC_VER
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
 #include "block.h"
 #include "building.h"
 #include "closures.h"
@@ -12,6 +17,7 @@
 #include "code_iterators.h"
 #include "dict.h"
 #include "evaluation.h"
+#include "file_watch.h"
 #include "function.h"
 #include "gc.h"
 #include "generic.h"
@@ -32,6 +38,7 @@
 #include "term.h"
 #include "type_inference.h"
 #include "type.h"
+#include "weak_ptrs.h"
 #include "world.h"
 
 #include "types/any.h"
@@ -220,6 +227,33 @@ void sys__perf_stats_dump(caStack* stack)
 {
     perf_stats_to_list(circa_output(stack, 0));
 }
+void sys__time(caStack* stack)
+{
+#ifdef _MSC_VER
+    set_float(circa_output(stack, 0), 0);
+#else
+    // Measured from the first call, so that the result fits in a float.
+    static double firstCall = -1;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    double seconds = now.tv_sec + now.tv_usec / 1000000.0;
+    if (firstCall < 0)
+        firstCall = seconds;
+
+    set_float(circa_output(stack, 0), (float) (seconds - firstCall));
+#endif
+}
+void sys__peak_memory(caStack* stack)
+{
+#ifdef _MSC_VER
+    set_int(circa_output(stack, 0), 0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    set_int(circa_output(stack, 0), (int) usage.ru_maxrss);
+#endif
+}
 
 void Dict__count(caStack* stack)
 {
@@ -263,17 +297,20 @@ void empty_list(caStack* stack)
     }
 }
 
+// Methods that return a modified container take the value out of their input register
+// (which belongs to this call) instead of copying it. If the caller passed its last
+// reference, the container is unshared and can be modified in place.
 void List__append(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
     copy(circa_input(stack, 1), list_append(out));
 }
 
 void List__concat(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     caValue* additions = circa_input(stack, 1);
 
@@ -282,7 +319,7 @@ void List__concat(caStack* stack)
 
     list_resize(out, oldLength + additionsLength);
     for (int i = 0; i < additionsLength; i++)
-        copy(list_get(additions, i), list_get(out, oldLength + i));
+        list_copy_element(additions, i, list_get(out, oldLength + i));
 }
 
 Type* List__append_specializeType(Term* term)
@@ -317,7 +354,7 @@ Type* List__append_specializeType(Term* term)
 void List__resize(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
     int count = circa_int_input(stack, 1);
     circa_resize(out, count);
 }
@@ -325,7 +362,7 @@ void List__resize(caStack* stack)
 void List__extend(caStack* stack)
 {
     caValue* out = circa_output(stack, 1);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     caValue* additions = circa_input(stack, 1);
 
@@ -334,7 +371,7 @@ void List__extend(caStack* stack)
 
     list_resize(out, oldLength + additionsLength);
     for (int i = 0; i < additionsLength; i++)
-        copy(list_get(additions, i), list_get(out, oldLength + i));
+        list_copy_element(additions, i, list_get(out, oldLength + i));
 }
 
 void List__count(caStack* stack)
@@ -349,7 +386,7 @@ void List__length(caStack* stack)
 void List__insert(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     copy(circa_input(stack, 1), list_insert(out, circa_int_input(stack, 2)));
 }
@@ -380,7 +417,7 @@ void List__slice(caStack* stack)
     set_list(output, length);
 
     for (int i=0; i < length; i++)
-        copy(list_get(input, start + i), list_get(output, i));
+        list_copy_element(input, start + i, list_get(output, i));
 }
 
 void List__join(caStack* stack)
@@ -391,11 +428,13 @@ void List__join(caStack* stack)
     caValue* out = circa_output(stack, 0);
     set_string(out, "");
 
+    Value item;
     for (int i=0; i < list_length(input); i++) {
         if (i != 0)
             string_append(out, joiner);
 
-        string_append(out, list_get(input, i));
+        list_copy_element(input, i, &item);
+        string_append(out, &item);
     }
 }
 
@@ -403,19 +442,18 @@ void List__get(caStack* stack)
 {
     caValue* self = circa_input(stack, 0);
     caValue* index = circa_input(stack, 1);
-    copy(list_get(self, as_int(index)), circa_output(stack, 0));
+    list_copy_element(self, as_int(index), circa_output(stack, 0));
 }
 
 void List__set(caStack* stack)
 {
     caValue* self = circa_output(stack, 0);
-    copy(circa_input(stack, 0), self);
+    move(circa_input(stack, 0), self);
 
     int index = circa_int_input(stack, 1);
     caValue* value = circa_input(stack, 2);
 
-    touch(self);
-    copy(value, list_get(self, index));
+    set_index(self, index, value);
 }
 
 void Map__contains(caStack* stack)
@@ -427,7 +465,7 @@ void Map__contains(caStack* stack)
 void Map__remove(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     hashtable_remove(out, circa_input(stack, 1));
 }
@@ -447,7 +485,7 @@ void Map__get(caStack* stack)
 void Map__set(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     caValue* key = circa_input(stack, 1);
     caValue* value = circa_input(stack, 2);
@@ -458,7 +496,7 @@ void Map__set(caStack* stack)
 void Map__insertPairs(caStack* stack)
 {
     caValue* out = circa_output(stack, 0);
-    copy(circa_input(stack, 0), out);
+    move(circa_input(stack, 0), out);
 
     caValue* pairs = circa_input(stack, 1);
     for (int i=0; i < list_length(pairs); i++) {
@@ -492,6 +530,15 @@ void MutableRelease(void* object)
     set_null(val);
 }
 
+void String__append(caStack* stack)
+{
+    // Appending to the moved value lets a string that's built up in a loop grow in place.
+    caValue* self = circa_output(stack, 1);
+    move(circa_input(stack, 0), self);
+    string_append(self, circa_input(stack, 1));
+    copy(self, circa_output(stack, 0));
+}
+
 void String__char_at(caStack* stack)
 {
     const char* str = circa_string_input(stack, 0);
@@ -1054,6 +1101,8 @@ void bootstrap_kernel()
         {"sys:module_search_paths", sys__module_search_paths},
         {"sys:perf_stats_reset", sys__perf_stats_reset},
         {"sys:perf_stats_dump", sys__perf_stats_dump},
+        {"sys:time", sys__time},
+        {"sys:peak_memory", sys__peak_memory},
 
         {"Dict.count", Dict__count},
         {"Dict.get", Dict__get},
@@ -1082,6 +1131,7 @@ void bootstrap_kernel()
         {"Mutable.get", Mutable__get},
         {"Mutable.set", Mutable__set},
 
+        {"String.append", String__append},
         {"String.char_at", String__char_at},
         {"String.ends_with", String__ends_with},
         {"String.length", String__length},
@@ -1146,6 +1196,9 @@ CIRCA_EXPORT caWorld* circa_initialize()
     memset(&FUNCS, 0, sizeof(FUNCS));
     memset(&TYPES, 0, sizeof(TYPES));
 
+    name_init_global_data();
+    weak_ptr_init_global_data();
+
     bootstrap_kernel();
 
     caWorld* world = global_world();
@@ -1188,9 +1241,13 @@ CIRCA_EXPORT void circa_shutdown(caWorld* world)
     delete world->root;
     world->root = NULL;
 
+    destroy_file_watch_world(world->fileWatchWorld);
+    world->fileWatchWorld = NULL;
+
     memset(&FUNCS, 0, sizeof(FUNCS));
 
     name_dealloc_global_data();
+    weak_ptr_dealloc_global_data();
 
     gc_collect();
 
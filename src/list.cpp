@@ -35,6 +35,139 @@ void assert_valid_list(ListData* list)
 
 #endif
 
+// List trie
+//
+// Each trie node has 32 slots. Leaf nodes (at shift 0) hold the list's items, and branch
+// nodes hold child pointers. A node that's referenced by more than one parent (or more
+// than one ListData) is shared, and has to be copied before anything under it can be
+// modified.
+
+const int ListTrieBits = 5;
+const int ListTrieWidth = 1 << ListTrieBits;
+const int ListTrieMask = ListTrieWidth - 1;
+
+struct ListTrieNode {
+    int refCount;
+
+    // 0 for leaf nodes.
+    int shift;
+
+    // Followed by [ListTrieWidth] caValues for leaf nodes, or [ListTrieWidth] child
+    // pointers for branch nodes.
+};
+
+static caValue* trie_items(ListTrieNode* node)
+{
+    return (caValue*) (node + 1);
+}
+
+static ListTrieNode** trie_children(ListTrieNode* node)
+{
+    return (ListTrieNode**) (node + 1);
+}
+
+static ListTrieNode* trie_create_node(int shift)
+{
+    size_t slotSize = shift == 0 ? sizeof(caValue) : sizeof(ListTrieNode*);
+    ListTrieNode* node = (ListTrieNode*) malloc(sizeof(ListTrieNode)
+        + ListTrieWidth * slotSize);
+    node->refCount = 1;
+    node->shift = shift;
+
+    if (shift == 0) {
+        memset(trie_items(node), 0, ListTrieWidth * sizeof(caValue));
+        for (int i=0; i < ListTrieWidth; i++)
+            initialize_null(&trie_items(node)[i]);
+    } else {
+        memset(trie_children(node), 0, ListTrieWidth * sizeof(ListTrieNode*));
+    }
+    return node;
+}
+
+static void trie_decref(ListTrieNode* node)
+{
+    if (node == NULL)
+        return;
+
+    ca_assert(node->refCount > 0);
+    node->refCount--;
+    if (node->refCount > 0)
+        return;
+
+    for (int i=0; i < ListTrieWidth; i++) {
+        if (node->shift == 0)
+            set_null(&trie_items(node)[i]);
+        else
+            trie_decref(trie_children(node)[i]);
+    }
+    free(node);
+}
+
+static ListTrieNode* trie_copy_node(ListTrieNode* node)
+{
+    INCREMENT_STAT(ListTrieNodeCopy);
+
+    ListTrieNode* dupe = trie_create_node(node->shift);
+    for (int i=0; i < ListTrieWidth; i++) {
+        if (node->shift == 0) {
+            copy(&trie_items(node)[i], &trie_items(dupe)[i]);
+        } else {
+            ListTrieNode* child = trie_children(node)[i];
+            if (child != NULL)
+                child->refCount++;
+            trie_children(dupe)[i] = child;
+        }
+    }
+    return dupe;
+}
+
+// Find an item without modifying anything. The result must not be modified, since the
+// leaf may be shared.
+static caValue* trie_get(ListData* data, int index)
+{
+    int trieIndex = data->trieOffset + index;
+    ListTrieNode* node = data->trie;
+    for (int shift = data->trieShift; shift > 0; shift -= ListTrieBits)
+        node = trie_children(node)[(trieIndex >> shift) & ListTrieMask];
+    return &trie_items(node)[trieIndex & ListTrieMask];
+}
+
+// Find an item that the caller may modify. Nodes on the path are created if missing, and
+// copied if shared.
+static caValue* trie_get_unshared(ListData* data, int index)
+{
+    int trieIndex = data->trieOffset + index;
+    ListTrieNode** nodePtr = &data->trie;
+    for (int shift = data->trieShift;; shift -= ListTrieBits) {
+        ListTrieNode* node = *nodePtr;
+        if (node == NULL) {
+            node = trie_create_node(shift);
+            *nodePtr = node;
+        } else if (node->refCount > 1) {
+            node = trie_copy_node(node);
+            trie_decref(*nodePtr);
+            *nodePtr = node;
+        }
+
+        if (shift == 0)
+            return &trie_items(node)[trieIndex & ListTrieMask];
+
+        nodePtr = &trie_children(node)[(trieIndex >> shift) & ListTrieMask];
+    }
+}
+
+// Add levels to the top of the trie until it can hold 'count' items.
+static void trie_reserve(ListData* data, int count)
+{
+    int needed = data->trieOffset + count;
+    while (needed > (ListTrieWidth << data->trieShift)) {
+        ListTrieNode* root = trie_create_node(data->trieShift + ListTrieBits);
+        trie_children(root)[0] = data->trie;
+        data->trie = root;
+        data->trieShift += ListTrieBits;
+    }
+}
+
 ListData* allocate_empty_list(int capacity)
 {
     ListData* result = (ListData*) malloc(sizeof(ListData) + capacity * sizeof(caValue));
@@ -44,6 +177,10 @@ ListData* allocate_empty_list(int capacity)
     result->count = 0;
     result->capacity = capacity;
     result->immutable = false;
+    result->trie = NULL;
+    result->trieShift = 0;
+    result->trieOffset = 0;
+    result->packedType = NULL;
     memset(result->items, 0, capacity * sizeof(caValue));
     for (int i=0; i < capacity; i++)
         initialize_null(&result->items[i]);
@@ -51,6 +188,91 @@ ListData* allocate_empty_list(int capacity)
     return result;
 }
 
+// Packed lists
+//
+// Elements are stored as raw ints or floats, both of which are 4 bytes. See
+// ListData.packedType.
+
+static bool is_packable_type(Type* type)
+{
+    return type == TYPES.int_type || type == TYPES.float_type;
+}
+
+static ListData* allocate_packed_list(Type* elementType, int capacity)
+{
+    ca_assert(is_packable_type(elementType));
+
+    ListData* result = (ListData*) malloc(sizeof(ListData) + capacity * sizeof(int));
+    debug_register_valid_object(result, LIST_OBJECT);
+
+    result->refCount = 1;
+    result->count = 0;
+    result->capacity = capacity;
+    result->immutable = false;
+    result->trie = NULL;
+    result->trieShift = 0;
+    result->trieOffset = 0;
+    result->packedType = elementType;
+    memset(result->items, 0, capacity * sizeof(int));
+    return result;
+}
+
+static int* packed_ints(ListData* data)
+{
+    return (int*) data->items;
+}
+
+static float* packed_floats(ListData* data)
+{
+    return (float*) data->items;
+}
+
+static void packed_read(ListData* data, int index, caValue* out)
+{
+    if (data->packedType == TYPES.int_type)
+        set_int(out, packed_ints(data)[index]);
+    else
+        set_float(out, packed_floats(data)[index]);
+}
+
+// Create an unpacked copy of a packed list, using the same storage as any other list of
+// that size: flat items, or a trie past ListTrieThreshold. Consumes 'original', which
+// other owners may still be using, and returns a list with 1 ref.
+static ListData* list_unpack(ListData* original)
+{
+    INCREMENT_STAT(ListUnpack);
+
+    ca_assert(original->packedType != NULL);
+    int count = original->count;
+
+    ListData* result;
+    if (count > ListTrieThreshold) {
+        result = allocate_empty_list(0);
+        result->trie = trie_create_node(0);
+        trie_reserve(result, count);
+        result->count = count;
+        for (int i=0; i < count; i++)
+            packed_read(original, i, trie_get_unshared(result, i));
+    } else {
+        result = allocate_list(count);
+        for (int i=0; i < count; i++)
+            packed_read(original, i, &result->items[i]);
+    }
+
+    list_decref(original);
+    return result;
+}
+
+// Returns the element at 'index' without unpacking the list. For a packed list the
+// element is written to 'scratch'. The result must not be modified.
+static caValue* list_peek(ListData* data, int index, caValue* scratch)
+{
+    if (data->packedType == NULL)
+        return list_get_readonly(data, index);
+    packed_read(data, index, scratch);
+    return scratch;
+}
+
 ListData* allocate_list(int size)
 {
     ListData* result = allocate_empty_list(size);
@@ -80,8 +302,12 @@ void free_list(ListData* data)
         return;
 
     // Release all elements
-    for (int i=0; i < data->count; i++)
-        set_null(&data->items[i]);
+    if (data->trie != NULL)
+        trie_decref(data->trie);
+    if (data->packedType == NULL) {
+        for (int i=0; i < data->count && i < data->capacity; i++)
+            set_null(&data->items[i]);
+    }
     free(data);
     debug_unregister_valid_object(data, LIST_OBJECT);
 }
@@ -101,14 +327,85 @@ caValue* list_get(ListData* data, int index)
     ca_assert(data != NULL);
     ca_assert(index < data->count);
     ca_assert(index >= 0);
+
+    // A packed list has no caValues to point to. Callers that can replace the ListData
+    // use list_get(caValue*), which unpacks it first.
+    ca_assert(data->packedType == NULL);
+
+    if (data->trie != NULL) {
+        // An immutable list may be shared, and its items must not be modified. Otherwise
+        // the caller owns this list and may modify the result, so unshare its leaf.
+        if (data->immutable)
+            return trie_get(data, index);
+        return trie_get_unshared(data, index);
+    }
+
     return &data->items[index];
 }
-caValue* list_get_from_end(ListData* data, int index)
+
+caValue* list_get_readonly(ListData* data, int index)
 {
     ca_assert(data != NULL);
     ca_assert(index < data->count);
     ca_assert(index >= 0);
-    return &data->items[data->count - index - 1];
+    ca_assert(data->packedType == NULL);
+
+    if (data->trie != NULL)
+        return trie_get(data, index);
+
+    return &data->items[index];
+}
+
+caValue* list_get_from_end(ListData* data, int index)
+{
+    ca_assert(data != NULL);
+    return list_get(data, data->count - index - 1);
+}
+
+// Move (or copy, if the list is shared) the items of a flat list into a new trie-based
+// list. Consumes 'original'.
+static ListData* list_convert_to_trie(ListData* original)
+{
+    ca_assert(original->trie == NULL);
+    ca_assert(original->packedType == NULL);
+
+    bool createCopy = original->refCount > 1 || original->immutable;
+
+    ListData* result = allocate_empty_list(0);
+    result->trie = trie_create_node(0);
+    trie_reserve(result, original->count);
+    result->count = original->count;
+
+    for (int i=0; i < original->count; i++) {
+        caValue* dest = trie_get_unshared(result, i);
+        if (createCopy)
+            copy(&original->items[i], dest);
+        else
+            swap(&original->items[i], dest);
+    }
+
+    list_decref(original);
+    return result;
+}
+
+// Resize a trie-based list. New items are null.
+static ListData* list_trie_resize(ListData* original, int newLength)
+{
+    ListData* result = list_touch(original);
+
+    // Items past the end may still be referenced by the trie (for example, if this list
+    // was shortened or sliced), so they are cleared either way.
+    if (newLength < result->count) {
+        for (int i=newLength; i < result->count; i++)
+            set_null(trie_get_unshared(result, i));
+    } else {
+        trie_reserve(result, newLength);
+        for (int i=result->count; i < newLength; i++)
+            set_null(trie_get_unshared(result, i));
+    }
+
+    result->count = newLength;
+    return result;
 }
 
 ListData* list_touch(ListData* original)
@@ -133,6 +430,30 @@ ListData* list_duplicate(ListData* source)
 
     assert_valid_list(source);
 
+    if (source->packedType != NULL) {
+        ListData* result = allocate_packed_list(source->packedType, source->count);
+        result->count = source->count;
+        memcpy(result->items, source->items, source->count * sizeof(int));
+        return result;
+    }
+
+    // A trie-based list shares all of its nodes with the duplicate.
+    if (source->trie != NULL) {
+        ListData* result = allocate_empty_list(0);
+        result->count = source->count;
+        result->trie = source->trie;
+        result->trieShift = source->trieShift;
+        result->trieOffset = source->trieOffset;
+        result->trie->refCount++;
+        return result;
+    }
+
+    // Large lists are switched to a trie, so that later duplicates are cheap.
+    if (source->count > ListTrieThreshold) {
+        list_incref(source);
+        return list_convert_to_trie(source);
+    }
+
     ListData* result = allocate_empty_list(source->capacity);
 
     result->count = source->count;
@@ -151,6 +472,8 @@ ListData* list_increase_capacity(ListData* original, int new_capacity)
         return allocate_empty_list(new_capacity);
 
     assert_valid_list(original);
+    ca_assert(original->trie == NULL);
+    ca_assert(original->packedType == NULL);
     ListData* result = allocate_empty_list(new_capacity);
 
     bool createCopy = original->refCount > 1;
@@ -180,6 +503,13 @@ ListData* list_double_capacity(ListData* original)
 
 ListData* list_resize(ListData* original, int newLength)
 {
+    // This is checked in release builds too, since a negative length (such as from
+    // popping an empty list) would turn into a huge allocation.
+    if (newLength < 0) {
+        internal_error("list_resize: negative length");
+        return original;
+    }
+
     // Check if 'original' is an empty list.
     if (original == NULL) {
 
@@ -203,6 +533,23 @@ ListData* list_resize(ListData* original, int newLength)
     if (original->count == newLength)
         return original;
 
+    // A packed list can shrink in place. New items are null, so growing unpacks it.
+    if (original->packedType != NULL) {
+        if (newLength < original->count) {
+            ListData* result = list_touch(original);
+            result->count = newLength;
+            return result;
+        }
+        original = list_unpack(original);
+    }
+
+    if (original->trie != NULL)
+        return list_trie_resize(original, newLength);
+
+    // Switch to a trie if this list is growing past the threshold.
+    if (newLength > original->capacity && newLength > ListTrieThreshold)
+        return list_trie_resize(list_convert_to_trie(original), newLength);
+
     // Increase capacity if necessary.
     if (newLength > original->capacity) {
         ListData* result = list_increase_capacity(original, newLength);
@@ -229,12 +576,28 @@ caValue* list_append(ListData** dataPtr)
         *dataPtr = allocate_empty_list(1);
     } else {
         *dataPtr = list_touch(*dataPtr);
-        
-        if ((*dataPtr)->count == (*dataPtr)->capacity)
-            *dataPtr = list_double_capacity(*dataPtr);
+
+        if ((*dataPtr)->packedType != NULL)
+            *dataPtr = list_unpack(*dataPtr);
+
+        if ((*dataPtr)->trie == NULL && (*dataPtr)->count == (*dataPtr)->capacity) {
+            if ((*dataPtr)->count >= ListTrieThreshold)
+                *dataPtr = list_convert_to_trie(*dataPtr);
+            else
+                *dataPtr = list_double_capacity(*dataPtr);
+        }
     }
 
     ListData* data = *dataPtr;
+
+    if (data->trie != NULL) {
+        trie_reserve(data, data->count + 1);
+        caValue* item = trie_get_unshared(data, data->count);
+        set_null(item);
+        data->count++;
+        return item;
+    }
+
     data->count++;
     return &data->items[data->count - 1];
 }
@@ -257,9 +620,9 @@ caValue* list_insert(ListData** dataPtr, int index)
 
     // Move everything over, up till 'index'.
     for (int i = data->count - 1; i >= (index + 1); i--)
-        swap(&data->items[i], &data->items[i - 1]);
+        swap(list_get(data, i), list_get(data, i - 1));
 
-    return &data->items[index];
+    return list_get(data, index);
 }
 
 int list_length(ListData* data)
@@ -272,13 +635,15 @@ int list_length(ListData* data)
 void list_remove_and_replace_with_last_element(ListData** data, int index)
 {
     *data = list_touch(*data);
+    if ((*data)->packedType != NULL)
+        *data = list_unpack(*data);
     ca_assert(index < (*data)->count);
 
-    set_null(&(*data)->items[index]);
+    set_null(list_get(*data, index));
 
     int lastElement = (*data)->count - 1;
     if (index < lastElement)
-        swap(&(*data)->items[index], &(*data)->items[lastElement]);
+        swap(list_get(*data, index), list_get(*data, lastElement));
 
     (*data)->count--;
 }
@@ -288,15 +653,19 @@ void list_remove_nulls(ListData** dataPtr)
     if (*dataPtr == NULL)
         return;
 
+    // A packed list can't hold nulls.
+    if ((*dataPtr)->packedType != NULL)
+        return;
+
     *dataPtr = list_touch(*dataPtr);
     ListData* data = *dataPtr;
 
     int numRemoved = 0;
     for (int i=0; i < data->count; i++) {
-        if (is_null(&data->items[i]))
+        if (is_null(list_get(data, i)))
             numRemoved++;
         else
-            swap(&data->items[i - numRemoved], &data->items[i]);
+            swap(list_get(data, i - numRemoved), list_get(data, i));
     }
     *dataPtr = list_resize(*dataPtr, data->count - numRemoved);
 }
@@ -326,11 +695,12 @@ std::string list_to_string(ListData* value)
     if (value == NULL)
         return "[]";
 
+    Value scratch;
     std::stringstream out;
     out << "[";
     for (int i=0; i < value->count; i++) {
         if (i > 0) out << ", ";
-        out << to_string(&value->items[i]);
+        out << to_string(list_peek(value, i, &scratch));
     }
     out << "]";
     return out.str();
@@ -363,12 +733,110 @@ void list_slice(caValue* original, int start, int end, caValue* result)
     if (resultCount < 0)
         resultCount = 0;
 
+    ListData* originalData = (ListData*) get_pointer(original);
+
+    if (resultCount > 0 && originalData->packedType != NULL) {
+        set_packed_list(result, originalData->packedType, resultCount);
+        memcpy(as_list_data(result)->items, packed_ints(originalData) + start,
+            resultCount * sizeof(int));
+        return;
+    }
+
+    // A slice of a trie-based list shares the trie, with a different offset and count.
+    if (resultCount > 0 && originalData->trie != NULL) {
+        ListData* sliceData = list_duplicate(originalData);
+        sliceData->trieOffset += start;
+        sliceData->count = resultCount;
+
+        set_list(result);
+        result->value_data.ptr = sliceData;
+        return;
+    }
+
     set_list(result, resultCount);
 
     for (int i=0; i < resultCount; i++)
         copy(list_get(original, i + start), list_get(result, i));
 }
 
+void set_packed_list(caValue* value, Type* elementType, int count)
+{
+    set_list(value);
+    if (count == 0)
+        return;
+
+    ListData* data = allocate_packed_list(elementType, count);
+    data->count = count;
+    value->value_data.ptr = data;
+}
+
+Type* list_packed_type(caValue* list)
+{
+    ListData* data = as_list_data(list);
+    if (data == NULL)
+        return NULL;
+    return data->packedType;
+}
+
+int* list_packed_ints(caValue* list)
+{
+    ListData* data = as_list_data(list);
+    if (data == NULL)
+        return NULL;
+    ca_assert(data->packedType == TYPES.int_type);
+    return packed_ints(data);
+}
+
+float* list_packed_floats(caValue* list)
+{
+    ListData* data = as_list_data(list);
+    if (data == NULL)
+        return NULL;
+    ca_assert(data->packedType == TYPES.float_type);
+    return packed_floats(data);
+}
+
+bool list_try_pack(caValue* list, Type* elementType)
+{
+    ca_assert(is_packable_type(elementType));
+
+    ListData* data = as_list_data(list);
+    if (data == NULL)
+        return false;
+    if (data->packedType != NULL)
+        return data->packedType == elementType;
+
+    int count = data->count;
+    for (int i=0; i < count; i++)
+        if (list_get(data, i)->value_type != elementType)
+            return false;
+
+    INCREMENT_STAT(ListPack);
+
+    ListData* packed = allocate_packed_list(elementType, count);
+    packed->count = count;
+    for (int i=0; i < count; i++) {
+        caValue* item = list_get(data, i);
+        if (elementType == TYPES.int_type)
+            packed_ints(packed)[i] = as_int(item);
+        else
+            packed_floats(packed)[i] = as_float(item);
+    }
+
+    list_decref(data);
+    list->value_data.ptr = packed;
+    return true;
+}
+
+void list_copy_element(caValue* list, int index, caValue* out)
+{
+    ListData* data = as_list_data(list);
+    if (data->packedType != NULL)
+        packed_read(data, index, out);
+    else
+        copy(list_get_readonly(data, index), out);
+}
+
 void list_reverse(caValue* list)
 {
     int count = list_length(list);
@@ -379,8 +847,9 @@ void list_reverse(caValue* list)
 
 bool list_contains(caValue* list, caValue* element)
 {
+    Value scratch;
     for (int i=0; i < list_length(list); i++)
-        if (equals(list_get(list, i), element))
+        if (equals(list_peek(as_list_data(list), i, &scratch), element))
             return true;
 
     return false;
@@ -389,13 +858,20 @@ bool list_contains(caValue* list, caValue* element)
 caValue* list_get(caValue* value, int index)
 {
     ca_assert(value->value_type->storageType == name_StorageTypeList);
-    return list_get((ListData*) value->value_data.ptr, index);
+    ListData* data = (ListData*) value->value_data.ptr;
+
+    // The caller may modify the result, so this value gets its own unpacked list.
+    if (data != NULL && data->packedType != NULL) {
+        data = list_unpack(data);
+        value->value_data.ptr = data;
+    }
+
+    return list_get(data, index);
 }
 
 caValue* list_get_from_end(caValue* value, int reverseIndex)
 {
-    ca_assert(value->value_type->storageType == name_StorageTypeList);
-    return list_get_from_end((ListData*) value->value_data.ptr, reverseIndex);
+    return list_get(value, list_length(value) - reverseIndex - 1);
 }
 caValue* list_get_safe(caValue* value, int index)
 {
@@ -409,9 +885,16 @@ ListData* list_remove_index(ListData* original, int index)
     ca_assert(index < original->count);
     ListData* result = list_touch(original);
 
+    if (result->packedType != NULL) {
+        memmove(packed_ints(result) + index, packed_ints(result) + index + 1,
+            (result->count - index - 1) * sizeof(int));
+        result->count--;
+        return result;
+    }
+
     for (int i=index; i < result->count - 1; i++)
-        swap(&result->items[i], &result->items[i+1]);
-    set_null(&result->items[result->count - 1]);
+        swap(list_get(result, i), list_get(result, i+1));
+    set_null(list_get(result, result->count - 1));
     result->count--;
     return result;
 }
@@ -420,7 +903,7 @@ void list_remove_index(caValue* list, int index)
 {
     ca_assert(list->value_type->storageType == name_StorageTypeList);
     ListData* data = (ListData*) list->value_data.ptr;
-    list_remove_index(data, index);
+    data = list_remove_index(data, index);
     list->value_data.ptr = data;
 }
 
@@ -444,7 +927,7 @@ caValue* list_append(caValue* list)
 void list_extend(caValue* list, caValue* rhsList)
 {
     for (int i=0; i < list_length(rhsList); i++)
-        copy(list_get(rhsList, i), list_append(list));
+        list_copy_element(rhsList, i, list_append(list));
 }
 
 caValue* list_insert(caValue* list, int index)
@@ -467,15 +950,31 @@ bool list_equals(caValue* left, caValue* right)
     if (left->value_data.ptr == right->value_data.ptr)
         return true;
 
+    // Same for trie-based lists that view the same part of one trie.
+    ListData* leftData = (ListData*) left->value_data.ptr;
+    ListData* rightData = (ListData*) right->value_data.ptr;
+    if (leftData != NULL && rightData != NULL && leftData->trie != NULL
+            && leftData->trie == rightData->trie
+            && leftData->trieOffset == rightData->trieOffset
+            && leftData->count == rightData->count)
+        return true;
+
     int leftCount = list_length(left);
 
     // Not equal if lengths differ.
     if (leftCount != list_length(right))
         return false;
 
+    // Two packed ints lists can be compared directly.
+    if (leftCount > 0 && leftData->packedType == TYPES.int_type
+            && rightData->packedType == TYPES.int_type)
+        return memcmp(leftData->items, rightData->items, leftCount * sizeof(int)) == 0;
+
     // Check every element.
+    Value leftScratch, rightScratch;
     for (int i=0; i < leftCount; i++) {
-        if (!equals(list_get(left, i), list_get(right, i)))
+        if (!equals(list_peek(leftData, i, &leftScratch),
+                    list_peek(rightData, i, &rightScratch)))
             return false;
     }
 
@@ -661,6 +1160,52 @@ Type* list_get_repeated_type_from_type(Type* type)
     ca_assert(is_list_based_type(type));
     return as_type(&type->parameter);
 }
+
+// Hash table from field name to field index, built on demand for a struct type. The
+// slots only store indexes, and each hit is checked against the type's name list, so
+// a stale table can't give a wrong answer. The table is rebuilt when the name list is
+// replaced or resized.
+struct FieldIndexTable
+{
+    ListData* names;
+    int nameCount;
+
+    // Power of two. Each slot holds a field index plus one, or 0 if empty.
+    int capacity;
+    int slots[1];
+};
+
+static FieldIndexTable* build_field_index_table(caValue* names)
+{
+    int count = list_length(names);
+    int capacity = 4;
+    while (capacity < count * 2)
+        capacity *= 2;
+
+    FieldIndexTable* table = (FieldIndexTable*) calloc(1,
+        sizeof(FieldIndexTable) + sizeof(int) * (capacity - 1));
+    table->names = (ListData*) names->value_data.ptr;
+    table->nameCount = count;
+    table->capacity = capacity;
+
+    for (int i=0; i < count; i++) {
+        caValue* name = list_get(names, i);
+        if (!is_string(name))
+            continue;
+        unsigned slot = hash_cstring(as_cstring(name)) & (capacity - 1);
+        while (table->slots[slot] != 0)
+            slot = (slot + 1) & (capacity - 1);
+        table->slots[slot] = i + 1;
+    }
+    return table;
+}
+
+void list_type_free_field_index(Type* type)
+{
+    free(type->fieldIndexTable);
+    type->fieldIndexTable = NULL;
+}
+
 int list_find_field_index_by_name(Type* listType, const char* name)
 {
     if (!is_list_based_type(listType))
@@ -670,11 +1215,27 @@ int list_find_field_index_by_name(Type* listType, const char* name)
     if (names == NULL)
         return -1;
 
+    FieldIndexTable* table = listType->fieldIndexTable;
+    if (table == NULL || table->names != (ListData*) names->value_data.ptr
+            || table->nameCount != list_length(names)) {
+        list_type_free_field_index(listType);
+        table = build_field_index_table(names);
+        listType->fieldIndexTable = table;
+    }
+
+    unsigned slot = hash_cstring(name) & (table->capacity - 1);
+    while (table->slots[slot] != 0) {
+        int index = table->slots[slot] - 1;
+        if (string_eq(list_get(names, index), name))
+            return index;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    // Not found. The name list may have been edited in place, so check it directly.
     for (int i=0; i < circa_count(names); i++)
         if (string_eq(circa_index(names, i), name))
             return i;
 
-    // Not found
     return -1;
 }
 
@@ -734,10 +1295,14 @@ namespace list_t {
         int sourceLength = list_length(value);
 
         // If the requested type doesn't have a specific size restriction, then
-        // the input data is fine as-is.
+        // the input data is fine as-is. A list that's declared to hold ints or numbers
+        // is packed, if its elements allow it.
         if (!list_type_has_specific_size(&type->parameter)) {
-            if (!checkOnly)
+            if (!checkOnly) {
                 value->value_type = type;
+                if (is_type(&type->parameter) && is_packable_type(as_type(&type->parameter)))
+                    list_try_pack(value, as_type(&type->parameter));
+            }
             return;
         }
 
@@ -755,8 +1320,11 @@ namespace list_t {
             value->value_type = type;
         }
 
+        // A check must not unpack the list.
+        Value scratch;
         for (int i=0; i < sourceLength; i++) {
-            caValue* sourceElement = list_get(value, i);
+            caValue* sourceElement = checkOnly
+                ? list_peek(as_list_data(value), i, &scratch) : list_get(value, i);
             Type* expectedType = as_type(destTypes[i]);
 
             INCREMENT_STAT(Cast_ListCastElement);
@@ -771,6 +1339,17 @@ namespace list_t {
     {
         ca_assert(is_list(value));
         list_touch(value);
+
+        // A packed list stays packed if the element has the same type.
+        ListData* data = as_list_data(value);
+        if (data->packedType != NULL && element->value_type == data->packedType) {
+            if (is_int(element))
+                packed_ints(data)[index] = as_int(element);
+            else
+                packed_floats(data)[index] = as_float(element);
+            return;
+        }
+
         copy(element, list_get(value, index));
     }
 
@@ -802,8 +1381,9 @@ namespace list_t {
     {
         int hash = 0;
         int count = list_length(value);
+        Value scratch;
         for (int i=0; i < count; i++) {
-            hash ^= get_hash_value(list_get(value, i));
+            hash ^= get_hash_value(list_peek(as_list_data(value), i, &scratch));
         }
         return hash;
     }
@@ -871,12 +1451,14 @@ namespace list_t {
     void tv_visit_heap(Type*, caValue* value, Type::VisitHeapCallback callback, caValue* context)
     {
         ListData* data = (ListData*) value->value_data.ptr;
-        if (data == NULL)
+
+        // Packed lists don't reference anything on the heap.
+        if (data == NULL || data->packedType != NULL)
             return;
         Value relativeIdentifier;
         for (int i=0; i < data->count; i++) {
             set_int(&relativeIdentifier, i);
-            callback(&data->items[i], &relativeIdentifier, context);
+            callback(list_get(data, i), &relativeIdentifier, context);
         }
     }
 
@@ -16,6 +16,12 @@
 
 namespace circa {
 
+struct ListTrieNode;
+
+// Lists longer than this are stored in a persistent trie (see ListData.trie), so that
+// copies of large lists can share structure.
+const int ListTrieThreshold = 256;
+
 struct ListData {
     int refCount;
     int count;
@@ -23,6 +29,22 @@ struct ListData {
     bool immutable;
     int checksum;
 
+    // For large lists, the items are stored in this trie instead of in 'items', and
+    // 'capacity' is 0. Element i is at index (trieOffset + i) in the trie, and the root
+    // node covers (32 << trieShift) indexes. Trie nodes are refcounted, and can be shared
+    // between lists; a mutable list copies any shared nodes on the path to an element
+    // when it's accessed.
+    ListTrieNode* trie;
+    int trieShift;
+    int trieOffset;
+
+    // A packed list stores raw numbers instead of tagged values. 'packedType' is
+    // TYPES.int_type or TYPES.float_type, and 'items' holds [capacity] ints or floats.
+    // Reads go through list_copy_element and don't change the storage. Anything that
+    // needs a caValue* for an element (such as list_get on a caValue) gives that value
+    // its own unpacked list, and other owners keep the packed one. NULL for a normal list.
+    Type* packedType;
+
     // items has size [capacity].
     caValue items[0];
 
@@ -40,7 +62,13 @@ void free_list(ListData* data);
 void list_make_immutable(ListData* data);
 ListData* as_list_data(caValue* val);
 
+// The list must not be packed; see list_get(caValue*).
 caValue* list_get(ListData* data, int index);
+
+// Get an element that will only be read. Unlike list_get, this doesn't unshare any part
+// of a trie-based list, so the result must not be modified. The list must not be packed.
+caValue* list_get_readonly(ListData* data, int index);
+
 caValue* list_get_from_end(ListData* data, int index);
 int list_length(ListData* data);
 caValue* list_append(ListData** dataPtr);
@@ -61,7 +89,8 @@ void list_touch(caValue* list);
 
 // Get an element by index. If the caller plans to modify the returned value,
 // or pass the value somewhere that may modify it (without making a copy),
-// then they must call list_touch before list_get.
+// then they must call list_touch before list_get. A packed list is replaced with an
+// unpacked copy first, so use list_copy_element to read without changing the storage.
 caValue* list_get(caValue* value, int index);
 
 // Get an element by index, counting from the end. For example, asking for
@@ -102,6 +131,28 @@ void list_copy(caValue* source, caValue* dest);
 std::string list_to_string(ListData* value);
 void list_slice(caValue* original, int start, int end, caValue* result);
 
+// Packed numeric lists
+
+// Set 'value' to a packed list of 'count' zeroes. 'elementType' must be TYPES.int_type
+// or TYPES.float_type.
+void set_packed_list(caValue* value, Type* elementType, int count);
+
+// Returns the element type of a packed list, or NULL if the list isn't packed.
+Type* list_packed_type(caValue* list);
+
+// Access the raw elements of a packed list. The list must be packed with the matching
+// type. As with list_get, call list_touch first if the elements will be modified.
+int* list_packed_ints(caValue* list);
+float* list_packed_floats(caValue* list);
+
+// Switch a list to packed storage, if every element has exactly the type 'elementType'
+// (which must be int or number). Returns true if the list is now packed.
+bool list_try_pack(caValue* list, Type* elementType);
+
+// Copy the element at 'index' into 'out'. Unlike list_get, this doesn't unpack a packed
+// list.
+void list_copy_element(caValue* list, int index, caValue* out);
+
 // Reverse the list.
 void list_reverse(caValue* list);
 
@@ -145,6 +196,9 @@ Type* list_get_repeated_type_from_type(Type* type);
 // Returns NULL if the field is not found.
 int list_find_field_index_by_name(Type* listType, const char* name);
 
+// Free the cached name->index table used by list_find_field_index_by_name.
+void list_type_free_field_index(Type* type);
+
 bool is_list_based_type(Type*);
 
 namespace list_t {
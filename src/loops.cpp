@@ -173,6 +173,15 @@ Term* loop_get_primary_result(Block* block)
     return find_last_non_comment_expression(block);
 }
 
+bool for_loop_produces_output(Term* forTerm)
+{
+    for (int i=0; i < user_count(forTerm); i++) {
+        if (forTerm->users[i]->function != FUNCS.extra_output)
+            return true;
+    }
+    return false;
+}
+
 void finish_for_loop(Term* forTerm)
 {
     Block* contents = nested_contents(forTerm);
@@ -389,13 +398,14 @@ void for_loop_finish_iteration(Stack* stack, bool enableLoopOutput)
         return;
     }
 
-    // If we're not finished yet, copy rebound outputs back to inputs.
+    // If we're not finished yet, move rebound outputs back to inputs. The next iteration
+    // writes the outputs again before it finishes, so this leaves the value unshared.
     for (int i=1;; i++) {
         Term* input = get_input_placeholder(contents, i);
         if (input == NULL)
             break;
         Term* output = get_output_placeholder(contents, i);
-        copy(get_frame_register(frame, output),
+        move(get_frame_register(frame, output),
             get_frame_register(frame, input));
 
         INCREMENT_STAT(Copy_LoopCopyRebound);
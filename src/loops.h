@@ -18,6 +18,10 @@ Term* find_enclosing_for_loop(Term* term);
 Block* find_enclosing_for_loop_contents(Term* term);
 
 bool is_for_loop(Block* block);
+
+// Check if the loop's primary output (the list of results from each iteration) is used.
+// Extra outputs (rebound values) don't count.
+bool for_loop_produces_output(Term* forTerm);
 Block* for_loop_get_zero_block(Block* forContents);
 void for_loop_remake_zero_block(Block* forContents);
 
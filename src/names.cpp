@@ -1,5 +1,7 @@
 // Copyright (c) Andrew Fischer. See LICENSE file for license terms.
 
+#include <algorithm>
+
 #include "common_headers.h"
 
 #include "block.h"
@@ -16,6 +18,8 @@
 
 #include "names.h"
 
+#include "circa/thread.h"
+
 namespace circa {
 
 struct RuntimeName
@@ -33,7 +37,147 @@ const int c_maxRuntimeNames = 2000;
 
 RuntimeName g_runtimeNames[c_maxRuntimeNames];
 int g_nextFreeNameIndex = 0;
-std::map<std::string,Name> g_stringToSymbol;
+
+// Interning table
+//
+// Maps strings to names (both builtin and runtime names), using open addressing with
+// linear probing. Lookups don't take a lock: a writer fills in a slot's hash before it
+// publishes the slot's name with a release store, and a reader loads the name with an
+// acquire load. When the table grows, the new table is fully built before it's published,
+// and the old table is kept alive (on the 'previous' list) until name_dealloc_global_data,
+// since a reader might still be probing it.
+//
+// Writers are serialized with g_nameTableMutex. The table and the mutex are created by
+// name_init_global_data, which circa_initialize calls before any other threads could be
+// using them.
+
+struct NameTableSlot {
+    unsigned hash;
+
+    // 0 if this slot is empty.
+    Name name;
+};
+
+struct NameTable {
+    // Power of two.
+    int capacity;
+    int count;
+
+    // Previous (smaller) table, retired when this one was created.
+    NameTable* previous;
+
+    NameTableSlot slots[0];
+    // slots has size [capacity].
+};
+
+NameTable* g_nameTable = NULL;
+caMutex* g_nameTableMutex = NULL;
+
+template <typename T>
+static T load_acquire(T* ptr)
+{
+#ifdef __GNUC__
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+    // MSVC gives volatile accesses acquire/release semantics.
+    return *(volatile T*) ptr;
+#endif
+}
+
+template <typename T>
+static void store_release(T* ptr, T value)
+{
+#ifdef __GNUC__
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#else
+    *(volatile T*) ptr = value;
+#endif
+}
+
+static bool name_string_equals(Name name, const char* str, int len)
+{
+    const char* nameStr = name_to_string(name);
+    return strncmp(nameStr, str, len) == 0 && nameStr[len] == 0;
+}
+
+static Name name_table_find(NameTable* table, const char* str, int len, unsigned hash)
+{
+    int mask = table->capacity - 1;
+    for (int i = hash & mask;; i = (i + 1) & mask) {
+        NameTableSlot* slot = &table->slots[i];
+        Name name = load_acquire(&slot->name);
+        if (name == 0)
+            return name_None;
+        if (slot->hash == hash && name_string_equals(name, str, len))
+            return name;
+    }
+}
+
+// Add a name to a table that has room for it. Must be called with the lock held (or
+// before the table is published).
+static void name_table_insert(NameTable* table, Name name, unsigned hash)
+{
+    int mask = table->capacity - 1;
+    int i = hash & mask;
+    while (table->slots[i].name != 0)
+        i = (i + 1) & mask;
+
+    table->slots[i].hash = hash;
+    store_release(&table->slots[i].name, name);
+    table->count++;
+}
+
+static NameTable* name_table_create(int capacity)
+{
+    NameTable* table = (NameTable*) malloc(sizeof(NameTable)
+        + capacity * sizeof(NameTableSlot));
+    table->capacity = capacity;
+    table->count = 0;
+    table->previous = NULL;
+    memset(table->slots, 0, capacity * sizeof(NameTableSlot));
+    return table;
+}
+
+static void name_table_add(Name name)
+{
+    const char* str = name_to_string(name);
+    unsigned hash = hash_cstring(str);
+
+    // Keep the load under 1/2.
+    if ((g_nameTable->count + 1) * 2 > g_nameTable->capacity) {
+        NameTable* grown = name_table_create(g_nameTable->capacity * 2);
+        for (int i=0; i < g_nameTable->capacity; i++) {
+            NameTableSlot* slot = &g_nameTable->slots[i];
+            if (slot->name != 0)
+                name_table_insert(grown, slot->name, slot->hash);
+        }
+        grown->previous = g_nameTable;
+        store_release(&g_nameTable, grown);
+    }
+
+    name_table_insert(g_nameTable, name, hash);
+}
+
+void name_init_global_data()
+{
+    if (g_nameTable != NULL)
+        return;
+
+    g_nameTableMutex = circa_create_mutex();
+    g_nameTable = name_table_create(2048);
+
+    // Builtin names are in the table too, so that a lookup only needs one probe.
+    for (Name name=1; name <= name_LastBuiltinName; name++)
+        if (builtin_name_to_string(name) != NULL)
+            name_table_add(name);
+}
+
+static Name name_table_lookup(const char* str, int len, unsigned hash)
+{
+    NameTable* table = load_acquire(&g_nameTable);
+    ca_assert(table != NULL);
+    return name_table_find(table, str, len, hash);
+}
 
 // run_name_search: takes a NameSearch object and actually performs the search.
 // There are many variations of find_name and find_local_name which all just wrap
@@ -57,6 +201,154 @@ bool fits_lookup_type(Term* term, Name type)
     return false;
 }
 
+// Positions of the name bindings in a block. Entries are only candidates: a term may have
+// been renamed or erased since it was indexed, so each entry is checked again when it's
+// used. But every term that currently has a name (or might expose nested names) has an
+// entry, as long as the index exists.
+struct BlockNameIndex {
+    // For each name, the indexes of the terms with that name, in increasing order.
+    std::map<Name, std::vector<int> > byName;
+
+    // Indexes of terms that might expose nested names, in increasing order.
+    std::vector<int> exposers;
+};
+
+static bool might_expose_nested_names(Term* term)
+{
+    return term->function != NULL
+        && (term->function == FUNCS.include_func || term->function == FUNCS.module);
+}
+
+static void push_index(std::vector<int>& list, int index)
+{
+    if (list.empty() || list.back() < index)
+        list.push_back(index);
+}
+
+static BlockNameIndex* get_name_index(Block* block)
+{
+    if (block->nameIndex != NULL)
+        return block->nameIndex;
+
+    BlockNameIndex* index = new BlockNameIndex();
+    for (int i=0; i < block->length(); i++) {
+        Term* term = block->get(i);
+        if (term == NULL)
+            continue;
+        if (term->nameSymbol != name_None)
+            index->byName[term->nameSymbol].push_back(i);
+        if (might_expose_nested_names(term))
+            index->exposers.push_back(i);
+    }
+
+    block->nameIndex = index;
+    return index;
+}
+
+void name_index_update(Term* term)
+{
+    Block* block = term->owningBlock;
+    BlockNameIndex* index = block->nameIndex;
+    if (index == NULL)
+        return;
+
+    // Entries are kept in order, so new entries can only be added for the last term.
+    // Otherwise rebuild the index later.
+    if (term->index != block->length() - 1) {
+        bool needsEntry = term->nameSymbol != name_None || might_expose_nested_names(term);
+        if (needsEntry)
+            name_index_invalidate(block);
+        return;
+    }
+
+    if (term->nameSymbol != name_None)
+        push_index(index->byName[term->nameSymbol], term->index);
+    if (might_expose_nested_names(term))
+        push_index(index->exposers, term->index);
+}
+
+void name_index_find_bindings(Block* block, Name name, TermList* results)
+{
+    results->clear();
+
+    BlockNameIndex* index = get_name_index(block);
+    std::map<Name, std::vector<int> >::iterator it = index->byName.find(name);
+    if (it == index->byName.end())
+        return;
+
+    std::vector<int>& list = it->second;
+    for (size_t i=0; i < list.size(); i++) {
+        Term* term = block->get(list[i]);
+        if (term != NULL && term->nameSymbol == name)
+            results->append(term);
+    }
+}
+
+void name_index_invalidate(Block* block)
+{
+    delete block->nameIndex;
+    block->nameIndex = NULL;
+}
+
+// Returns the number of entries in 'list' that are less than 'position'.
+static int count_below(std::vector<int> const& list, int position)
+{
+    return int(std::lower_bound(list.begin(), list.end(), position) - list.begin());
+}
+
+// Search the terms before 'position' in the block, using the name index. This visits
+// the same terms, in the same order, as walking backwards through the block would.
+static Term* search_block_terms(NameSearch* params, int position)
+{
+    Block* block = params->block;
+    BlockNameIndex* index = get_name_index(block);
+
+    std::vector<int>* named = NULL;
+    std::map<Name, std::vector<int> >::iterator it = index->byName.find(params->name);
+    if (it != index->byName.end())
+        named = &it->second;
+
+    int namedLeft = named == NULL ? 0 : count_below(*named, position);
+    int exposersLeft = count_below(index->exposers, position);
+
+    while (namedLeft > 0 || exposersLeft > 0) {
+        int nextNamed = namedLeft > 0 ? (*named)[namedLeft - 1] : -1;
+        int nextExposer = exposersLeft > 0 ? index->exposers[exposersLeft - 1] : -1;
+        int i = nextNamed > nextExposer ? nextNamed : nextExposer;
+
+        Term* term = block->get(i);
+
+        if (i == nextNamed) {
+            namedLeft--;
+            if (term != NULL
+                    && term->nameSymbol == params->name
+                    && fits_lookup_type(term, params->lookupType)
+                    && (params->ordinal == -1 || term->uniqueOrdinal == params->ordinal))
+                return term;
+        }
+
+        if (i == nextExposer) {
+            exposersLeft--;
+
+            // If this term exposes its names, then search inside the nested block.
+            if (term != NULL && exposes_nested_names(term)) {
+                NameSearch nestedSearch;
+                nestedSearch.block = term->nestedContents;
+                nestedSearch.name = params->name;
+                nestedSearch.position = -1;
+                nestedSearch.ordinal = -1;
+                nestedSearch.lookupType = params->lookupType;
+                nestedSearch.searchParent = false;
+                Term* nested = run_name_search(&nestedSearch);
+                if (nested != NULL)
+                    return nested;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 Term* run_name_search(NameSearch* params)
 {
     if (params->name == 0)
@@ -76,30 +368,9 @@ Term* run_name_search(NameSearch* params)
         position = block->length();
 
     // Look for an exact match.
-    for (int i = position - 1; i >= 0; i--) {
-        Term* term = block->get(i);
-        if (term == NULL)
-            continue;
-
-        if (term->nameSymbol == params->name
-                && fits_lookup_type(term, params->lookupType)
-                && (params->ordinal == -1 || term->uniqueOrdinal == params->ordinal))
-            return term;
-
-        // If this term exposes its names, then search inside the nested block.
-        if (term->nestedContents != NULL && exposes_nested_names(term)) {
-            NameSearch nestedSearch;
-            nestedSearch.block = term->nestedContents;
-            nestedSearch.name = params->name;
-            nestedSearch.position = -1;
-            nestedSearch.ordinal = -1;
-            nestedSearch.lookupType = params->lookupType;
-            nestedSearch.searchParent = false;
-            Term* nested = run_name_search(&nestedSearch);
-            if (nested != NULL)
-                return nested;
-        }
-    }
+    Term* found = search_block_terms(params, position);
+    if (found != NULL)
+        return found;
 
     // Check if the name is a qualified name.
     Name namespacePrefix = qualified_name_get_first_section(params->name);
@@ -786,34 +1057,18 @@ Name existing_name_from_string(const char* str)
 {
     INCREMENT_STAT(InternedNameLookup);
 
-    int builtinName = builtin_name_from_string(str);
-    if (builtinName != -1)
-        return builtinName;
-
-    std::map<std::string,Name>::const_iterator it;
-    it = g_stringToSymbol.find(str);
-    if (it != g_stringToSymbol.end())
-        return it->second;
-
-    return 0;
+    int len = strlen(str);
+    return name_table_lookup(str, len, hash_string_range(str, len));
 }
 
 Name existing_name_from_string(const char* str, int len)
 {
     INCREMENT_STAT(InternedNameLookup);
 
-    std::string s;
     if (len == -1)
-        s = str;
-    else
-        s = std::string(str, len);
+        len = strlen(str);
 
-    std::map<std::string,Name>::const_iterator it;
-    it = g_stringToSymbol.find(s);
-    if (it != g_stringToSymbol.end())
-        return it->second;
-
-    return 0;
+    return name_table_lookup(str, len, hash_string_range(str, len));
 }
 
 // Runtime symbols
@@ -824,37 +1079,49 @@ Name name_from_string(const char* str)
         return name_None;
 
     // Check if name is already registered
-    Name existing = existing_name_from_string(str);
+    int len = strlen(str);
+    unsigned hash = hash_string_range(str, len);
+    INCREMENT_STAT(InternedNameLookup);
+    Name existing = name_table_lookup(str, len, hash);
     if (existing != name_None)
         return existing;
 
-    // Not yet registered; add it to the list.
-    INCREMENT_STAT(InternedNameCreate);
+    // If this is a qualified name, then intern the sections first, outside of the lock.
+    Name namespaceFirst = name_None;
+    Name namespaceRightRemainder = name_None;
+    const char* separator = strchr(str, ':');
+    if (separator != NULL) {
+        int firstLen = int(separator - str);
+        char* tempstr = (char*) malloc(firstLen + 1);
+        memcpy(tempstr, str, firstLen);
+        tempstr[firstLen] = 0;
+
+        namespaceFirst = name_from_string(tempstr);
+        namespaceRightRemainder = name_from_string(separator + 1);
+        free(tempstr);
+    }
+
+    circa_thread_mutex_lock(g_nameTableMutex);
 
-    Name index = g_nextFreeNameIndex++;
-    g_runtimeNames[index].str = strdup(str);
-    g_runtimeNames[index].namespaceFirst = 0;
-    g_runtimeNames[index].namespaceRightRemainder = 0;
-    Name name = index + c_FirstRuntimeName;
-    g_stringToSymbol[str] = name;
+    // Check again, another thread may have added it.
+    Name name = name_table_find(g_nameTable, str, len, hash);
 
-    // Search the string for a : name, if found we'll update the name's
-    // namespace links.
-    int len = strlen(str);
-    for (int i=0; i < len; i++) {
-        if (str[i] == ':') {
-            // Create a temporary string to hold the substring before :
-            char* tempstr = (char*) malloc(i + 1);
-            memcpy(tempstr, str, i);
-            tempstr[i] = 0;
-
-            g_runtimeNames[index].namespaceFirst = name_from_string(tempstr);
-            g_runtimeNames[index].namespaceRightRemainder = name_from_string(str + i + 1);
-            free(tempstr);
-            break;
-        }
+    if (name == name_None) {
+        // Not yet registered; add it to the list.
+        INCREMENT_STAT(InternedNameCreate);
+
+        int index = g_nextFreeNameIndex;
+        ca_assert(index < c_maxRuntimeNames);
+        g_runtimeNames[index].str = strdup(str);
+        g_runtimeNames[index].namespaceFirst = namespaceFirst;
+        g_runtimeNames[index].namespaceRightRemainder = namespaceRightRemainder;
+        store_release(&g_nextFreeNameIndex, index + 1);
+
+        name = index + c_FirstRuntimeName;
+        name_table_add(name);
     }
 
+    circa_thread_mutex_unlock(g_nameTableMutex);
     return name;
 }
 Name name_from_string(std::string const& str)
@@ -870,7 +1137,14 @@ void name_dealloc_global_data()
     for (int i=0; i < g_nextFreeNameIndex; i++)
         free(g_runtimeNames[i].str);
     g_nextFreeNameIndex = 0;
-    g_stringToSymbol.clear();
+
+    while (g_nameTable != NULL) {
+        NameTable* previous = g_nameTable->previous;
+        free(g_nameTable);
+        g_nameTable = previous;
+    }
+    circa_destroy_mutex(g_nameTableMutex);
+    g_nameTableMutex = NULL;
 }
 
 } // namespace circa
@@ -29,6 +29,22 @@ struct NameSearch
     bool searchParent;
 };
 
+// Name index
+//
+// Each block has an index from names to the positions of the terms bound to those names,
+// used by run_name_search instead of scanning every term. The index is built when it's
+// first needed, and updated or discarded whenever the block's terms change.
+
+// Update the owning block's name index after 'term' was appended, renamed, or had its
+// function changed.
+void name_index_update(Term* term);
+
+// Find every term in the block that is bound to 'name', in order.
+void name_index_find_bindings(Block* block, Name name, TermList* results);
+
+// Discard the block's name index, because terms were inserted, moved or removed.
+void name_index_invalidate(Block* block);
+
 // Finds a name in this block or a visible parent block.
 Term* find_name(Block* block,
                 Name name,
@@ -116,6 +132,9 @@ Name name_from_string(const char* str);
 Name name_from_string(std::string const& str);
 Name name_from_string(caValue* str);
 
+// Create the interning table, this is called by circa_initialize
+void name_init_global_data();
+
 // Deallocate all interned names, this should be called at shutdown
 void name_dealloc_global_data();
 
@@ -157,6 +157,10 @@ const char* builtin_name_to_string(int name)
     case op_SetNull: return "op_SetNull";
     case op_InlineCopy: return "op_InlineCopy";
     case op_CallBlock: return "op_CallBlock";
+    case op_CallNative: return "op_CallNative";
+    case op_TailCall: return "op_TailCall";
+    case op_GetField: return "op_GetField";
+    case op_SetField: return "op_SetField";
     case op_DynamicCall: return "op_DynamicCall";
     case op_ClosureCall: return "op_ClosureCall";
     case op_FireNative: return "op_FireNative";
@@ -172,6 +176,7 @@ const char* builtin_name_to_string(int name)
     case name_OutputsToList: return "OutputsToList";
     case name_Multiple: return "Multiple";
     case name_Cast: return "Cast";
+    case name_Copy: return "Copy";
     case name_DynamicMethodOutput: return "DynamicMethodOutput";
     case name_FirstStatIndex: return "FirstStatIndex";
     case stat_TermsCreated: return "stat_TermsCreated";
@@ -184,6 +189,7 @@ const char* builtin_name_to_string(int name)
     case stat_Copy_PushFrameWithInputs: return "stat_Copy_PushFrameWithInputs";
     case stat_Copy_ListDuplicate: return "stat_Copy_ListDuplicate";
     case stat_Copy_LoopCopyRebound: return "stat_Copy_LoopCopyRebound";
+    case stat_Move_PushedInput: return "stat_Move_PushedInput";
     case stat_Cast_ListCastElement: return "stat_Cast_ListCastElement";
     case stat_Cast_PushFrameWithInputs: return "stat_Cast_PushFrameWithInputs";
     case stat_Cast_FinishFrame: return "stat_Cast_FinishFrame";
@@ -197,10 +203,16 @@ const char* builtin_name_to_string(int name)
     case stat_ListsGrown: return "stat_ListsGrown";
     case stat_ListSoftCopy: return "stat_ListSoftCopy";
     case stat_ListHardCopy: return "stat_ListHardCopy";
+    case stat_ListTrieNodeCopy: return "stat_ListTrieNodeCopy";
+    case stat_ListPack: return "stat_ListPack";
+    case stat_ListUnpack: return "stat_ListUnpack";
     case stat_DictHardCopy: return "stat_DictHardCopy";
+    case stat_HashtableSoftCopy: return "stat_HashtableSoftCopy";
+    case stat_HashtableNodeCopy: return "stat_HashtableNodeCopy";
     case stat_StringCreate: return "stat_StringCreate";
     case stat_StringDuplicate: return "stat_StringDuplicate";
     case stat_StringResizeInPlace: return "stat_StringResizeInPlace";
+    case stat_StringBufferGrow: return "stat_StringBufferGrow";
     case stat_StringResizeCreate: return "stat_StringResizeCreate";
     case stat_StringSoftCopy: return "stat_StringSoftCopy";
     case stat_StringToStd: return "stat_StringToStd";
@@ -208,9 +220,22 @@ const char* builtin_name_to_string(int name)
     case stat_InterpreterCastOutputFromFinishedFrame: return "stat_InterpreterCastOutputFromFinishedFrame";
     case stat_BlockNameLookups: return "stat_BlockNameLookups";
     case stat_PushFrame: return "stat_PushFrame";
+    case stat_CallNative: return "stat_CallNative";
+    case stat_TailCall: return "stat_TailCall";
+    case stat_GetFieldByIndex: return "stat_GetFieldByIndex";
+    case stat_SetFieldByIndex: return "stat_SetFieldByIndex";
     case stat_LoopFinishIteration: return "stat_LoopFinishIteration";
     case stat_LoopWriteOutput: return "stat_LoopWriteOutput";
     case stat_WriteTermBytecode: return "stat_WriteTermBytecode";
+    case stat_GcStep: return "stat_GcStep";
+    case stat_GcCycle: return "stat_GcCycle";
+    case stat_GcObjectFreed: return "stat_GcObjectFreed";
+    case stat_GcPauseMicros: return "stat_GcPauseMicros";
+    case stat_GcMaxPauseMicros: return "stat_GcMaxPauseMicros";
+    case stat_GcMinorCollect: return "stat_GcMinorCollect";
+    case stat_GcPromoted: return "stat_GcPromoted";
+    case stat_FileWatchMtimeCheck: return "stat_FileWatchMtimeCheck";
+    case stat_FileWatchEvent: return "stat_FileWatchEvent";
     case stat_DynamicCall: return "stat_DynamicCall";
     case stat_FinishDynamicCall: return "stat_FinishDynamicCall";
     case stat_DynamicMethodCall: return "stat_DynamicMethodCall";
@@ -240,6 +265,10 @@ int builtin_name_from_string(const char* str)
     case 'o':
     switch (str[2]) {
     default: return -1;
+    case 'p':
+        if (strcmp(str + 3, "y") == 0)
+            return name_Copy;
+        break;
     case 'n':
     switch (str[3]) {
     default: return -1;
@@ -450,9 +479,21 @@ int builtin_name_from_string(const char* str)
             return op_CaseBlock;
         break;
     case 'l':
-        if (strcmp(str + 6, "lBlock") == 0)
+    switch (str[6]) {
+    default: return -1;
+    case 'l':
+    switch (str[7]) {
+    default: return -1;
+    case 'B':
+        if (strcmp(str + 8, "lock") == 0)
             return op_CallBlock;
         break;
+    case 'N':
+        if (strcmp(str + 8, "ative") == 0)
+            return op_CallNative;
+        break;
+    }
+    }
     }
     case 'l':
         if (strcmp(str + 5, "osureCall") == 0)
@@ -495,6 +536,10 @@ int builtin_name_from_string(const char* str)
         if (strcmp(str + 4, "ynamicCall") == 0)
             return op_DynamicCall;
         break;
+    case 'G':
+        if (strcmp(str + 4, "etField") == 0)
+            return op_GetField;
+        break;
     case 'F':
     switch (str[4]) {
     default: return -1;
@@ -548,9 +593,29 @@ int builtin_name_from_string(const char* str)
             return op_Pause;
         break;
     case 'S':
-        if (strcmp(str + 4, "etNull") == 0)
+    switch (str[4]) {
+    default: return -1;
+    case 'e':
+    switch (str[5]) {
+    default: return -1;
+    case 't':
+    switch (str[6]) {
+    default: return -1;
+    case 'N':
+        if (strcmp(str + 7, "ull") == 0)
             return op_SetNull;
         break;
+    case 'F':
+        if (strcmp(str + 7, "ield") == 0)
+            return op_SetField;
+        break;
+    }
+    }
+    }
+    case 'T':
+        if (strcmp(str + 4, "ailCall") == 0)
+            return op_TailCall;
+        break;
     }
     }
     }
@@ -627,6 +692,10 @@ int builtin_name_from_string(const char* str)
     }
     }
     }
+    case 'l':
+        if (strcmp(str + 8, "lNative") == 0)
+            return stat_CallNative;
+        break;
     }
     case 'o':
     switch (str[7]) {
@@ -757,10 +826,102 @@ int builtin_name_from_string(const char* str)
     }
     }
     }
+    case 'G':
+    switch (str[6]) {
+    default: return -1;
+    case 'c':
+    switch (str[7]) {
+    default: return -1;
+    case 'P':
+    switch (str[8]) {
+    default: return -1;
+    case 'a':
+        if (strcmp(str + 9, "useMicros") == 0)
+            return stat_GcPauseMicros;
+        break;
+    case 'r':
+        if (strcmp(str + 9, "omoted") == 0)
+            return stat_GcPromoted;
+        break;
+    }
+    case 'S':
+        if (strcmp(str + 8, "tep") == 0)
+            return stat_GcStep;
+        break;
+    case 'M':
+    switch (str[8]) {
+    default: return -1;
+    case 'a':
+        if (strcmp(str + 9, "xPauseMicros") == 0)
+            return stat_GcMaxPauseMicros;
+        break;
+    case 'i':
+        if (strcmp(str + 9, "norCollect") == 0)
+            return stat_GcMinorCollect;
+        break;
+    }
+    case 'C':
+        if (strcmp(str + 8, "ycle") == 0)
+            return stat_GcCycle;
+        break;
+    case 'O':
+        if (strcmp(str + 8, "bjectFreed") == 0)
+            return stat_GcObjectFreed;
+        break;
+    }
+    case 'e':
+        if (strcmp(str + 7, "tFieldByIndex") == 0)
+            return stat_GetFieldByIndex;
+        break;
+    }
     case 'F':
-        if (strcmp(str + 6, "inishDynamicCall") == 0)
+    switch (str[6]) {
+    default: return -1;
+    case 'i':
+    switch (str[7]) {
+    default: return -1;
+    case 'l':
+    switch (str[8]) {
+    default: return -1;
+    case 'e':
+    switch (str[9]) {
+    default: return -1;
+    case 'W':
+    switch (str[10]) {
+    default: return -1;
+    case 'a':
+    switch (str[11]) {
+    default: return -1;
+    case 't':
+    switch (str[12]) {
+    default: return -1;
+    case 'c':
+    switch (str[13]) {
+    default: return -1;
+    case 'h':
+    switch (str[14]) {
+    default: return -1;
+    case 'M':
+        if (strcmp(str + 15, "timeCheck") == 0)
+            return stat_FileWatchMtimeCheck;
+        break;
+    case 'E':
+        if (strcmp(str + 15, "vent") == 0)
+            return stat_FileWatchEvent;
+        break;
+    }
+    }
+    }
+    }
+    }
+    }
+    }
+    case 'n':
+        if (strcmp(str + 8, "ishDynamicCall") == 0)
             return stat_FinishDynamicCall;
         break;
+    }
+    }
     case 'I':
     switch (str[6]) {
     default: return -1;
@@ -821,6 +982,54 @@ int builtin_name_from_string(const char* str)
     }
     }
     }
+    case 'H':
+    switch (str[6]) {
+    default: return -1;
+    case 'a':
+    switch (str[7]) {
+    default: return -1;
+    case 's':
+    switch (str[8]) {
+    default: return -1;
+    case 'h':
+    switch (str[9]) {
+    default: return -1;
+    case 't':
+    switch (str[10]) {
+    default: return -1;
+    case 'a':
+    switch (str[11]) {
+    default: return -1;
+    case 'b':
+    switch (str[12]) {
+    default: return -1;
+    case 'l':
+    switch (str[13]) {
+    default: return -1;
+    case 'e':
+    switch (str[14]) {
+    default: return -1;
+    case 'S':
+        if (strcmp(str + 15, "oftCopy") == 0)
+            return stat_HashtableSoftCopy;
+        break;
+    case 'N':
+        if (strcmp(str + 15, "odeCopy") == 0)
+            return stat_HashtableNodeCopy;
+        break;
+    }
+    }
+    }
+    }
+    }
+    }
+    }
+    }
+    }
+    case 'M':
+        if (strcmp(str + 6, "ove_PushedInput") == 0)
+            return stat_Move_PushedInput;
+        break;
     case 'L':
     switch (str[6]) {
     default: return -1;
@@ -849,10 +1058,22 @@ int builtin_name_from_string(const char* str)
             return stat_ListsGrown;
         break;
     }
+    case 'P':
+        if (strcmp(str + 10, "ack") == 0)
+            return stat_ListPack;
+        break;
     case 'S':
         if (strcmp(str + 10, "oftCopy") == 0)
             return stat_ListSoftCopy;
         break;
+    case 'U':
+        if (strcmp(str + 10, "npack") == 0)
+            return stat_ListUnpack;
+        break;
+    case 'T':
+        if (strcmp(str + 10, "rieNodeCopy") == 0)
+            return stat_ListTrieNodeCopy;
+        break;
     }
     }
     }
@@ -895,9 +1116,33 @@ int builtin_name_from_string(const char* str)
             return stat_SetIndex;
         break;
     case 'F':
-        if (strcmp(str + 9, "ield") == 0)
+    switch (str[9]) {
+    default: return -1;
+    case 'i':
+    switch (str[10]) {
+    default: return -1;
+    case 'e':
+    switch (str[11]) {
+    default: return -1;
+    case 'l':
+    switch (str[12]) {
+    default: return -1;
+    case 'd':
+    switch (str[13]) {
+    default: return -1;
+    case 0:
+        if (strcmp(str + 14, "") == 0)
             return stat_SetField;
         break;
+    case 'B':
+        if (strcmp(str + 14, "yIndex") == 0)
+            return stat_SetFieldByIndex;
+        break;
+    }
+    }
+    }
+    }
+    }
     }
     }
     case 't':
@@ -915,6 +1160,18 @@ int builtin_name_from_string(const char* str)
     case 'g':
     switch (str[11]) {
     default: return -1;
+    case 'C':
+        if (strcmp(str + 12, "reate") == 0)
+            return stat_StringCreate;
+        break;
+    case 'B':
+        if (strcmp(str + 12, "ufferGrow") == 0)
+            return stat_StringBufferGrow;
+        break;
+    case 'D':
+        if (strcmp(str + 12, "uplicate") == 0)
+            return stat_StringDuplicate;
+        break;
     case 'S':
         if (strcmp(str + 12, "oftCopy") == 0)
             return stat_StringSoftCopy;
@@ -951,18 +1208,10 @@ int builtin_name_from_string(const char* str)
     }
     }
     }
-    case 'C':
-        if (strcmp(str + 12, "reate") == 0)
-            return stat_StringCreate;
-        break;
     case 'T':
         if (strcmp(str + 12, "oStd") == 0)
             return stat_StringToStd;
         break;
-    case 'D':
-        if (strcmp(str + 12, "uplicate") == 0)
-            return stat_StringDuplicate;
-        break;
     }
     }
     }
@@ -976,6 +1225,10 @@ int builtin_name_from_string(const char* str)
     case 'T':
     switch (str[6]) {
     default: return -1;
+    case 'a':
+        if (strcmp(str + 7, "ilCall") == 0)
+            return stat_TailCall;
+        break;
     case 'e':
     switch (str[7]) {
     default: return -1;
@@ -150,67 +150,92 @@ const int op_Pause = 140;
 const int op_SetNull = 141;
 const int op_InlineCopy = 142;
 const int op_CallBlock = 143;
-const int op_DynamicCall = 144;
-const int op_ClosureCall = 145;
-const int op_FireNative = 146;
-const int op_CaseBlock = 147;
-const int op_ForLoop = 148;
-const int op_ExitPoint = 149;
-const int op_FinishFrame = 150;
-const int op_FinishLoop = 151;
-const int op_ErrorNotEnoughInputs = 152;
-const int op_ErrorTooManyInputs = 153;
-const int name_LoopProduceOutput = 154;
-const int name_FlatOutputs = 155;
-const int name_OutputsToList = 156;
-const int name_Multiple = 157;
-const int name_Cast = 158;
-const int name_DynamicMethodOutput = 159;
-const int name_FirstStatIndex = 160;
-const int stat_TermsCreated = 161;
-const int stat_TermPropAdded = 162;
-const int stat_TermPropAccess = 163;
-const int stat_InternedNameLookup = 164;
-const int stat_InternedNameCreate = 165;
-const int stat_Copy_PushedInputNewFrame = 166;
-const int stat_Copy_PushedInputMultiNewFrame = 167;
-const int stat_Copy_PushFrameWithInputs = 168;
-const int stat_Copy_ListDuplicate = 169;
-const int stat_Copy_LoopCopyRebound = 170;
-const int stat_Cast_ListCastElement = 171;
-const int stat_Cast_PushFrameWithInputs = 172;
-const int stat_Cast_FinishFrame = 173;
-const int stat_Touch_ListCast = 174;
-const int stat_ValueCreates = 175;
-const int stat_ValueCopies = 176;
-const int stat_ValueCast = 177;
-const int stat_ValueCastDispatched = 178;
-const int stat_ValueTouch = 179;
-const int stat_ListsCreated = 180;
-const int stat_ListsGrown = 181;
-const int stat_ListSoftCopy = 182;
-const int stat_ListHardCopy = 183;
-const int stat_DictHardCopy = 184;
-const int stat_StringCreate = 185;
-const int stat_StringDuplicate = 186;
-const int stat_StringResizeInPlace = 187;
-const int stat_StringResizeCreate = 188;
-const int stat_StringSoftCopy = 189;
-const int stat_StringToStd = 190;
-const int stat_StepInterpreter = 191;
-const int stat_InterpreterCastOutputFromFinishedFrame = 192;
-const int stat_BlockNameLookups = 193;
-const int stat_PushFrame = 194;
-const int stat_LoopFinishIteration = 195;
-const int stat_LoopWriteOutput = 196;
-const int stat_WriteTermBytecode = 197;
-const int stat_DynamicCall = 198;
-const int stat_FinishDynamicCall = 199;
-const int stat_DynamicMethodCall = 200;
-const int stat_SetIndex = 201;
-const int stat_SetField = 202;
-const int name_LastStatIndex = 203;
-const int name_LastBuiltinName = 204;
+const int op_CallNative = 144;
+const int op_TailCall = 145;
+const int op_GetField = 146;
+const int op_SetField = 147;
+const int op_DynamicCall = 148;
+const int op_ClosureCall = 149;
+const int op_FireNative = 150;
+const int op_CaseBlock = 151;
+const int op_ForLoop = 152;
+const int op_ExitPoint = 153;
+const int op_FinishFrame = 154;
+const int op_FinishLoop = 155;
+const int op_ErrorNotEnoughInputs = 156;
+const int op_ErrorTooManyInputs = 157;
+const int name_LoopProduceOutput = 158;
+const int name_FlatOutputs = 159;
+const int name_OutputsToList = 160;
+const int name_Multiple = 161;
+const int name_Cast = 162;
+const int name_Copy = 163;
+const int name_DynamicMethodOutput = 164;
+const int name_FirstStatIndex = 165;
+const int stat_TermsCreated = 166;
+const int stat_TermPropAdded = 167;
+const int stat_TermPropAccess = 168;
+const int stat_InternedNameLookup = 169;
+const int stat_InternedNameCreate = 170;
+const int stat_Copy_PushedInputNewFrame = 171;
+const int stat_Copy_PushedInputMultiNewFrame = 172;
+const int stat_Copy_PushFrameWithInputs = 173;
+const int stat_Copy_ListDuplicate = 174;
+const int stat_Copy_LoopCopyRebound = 175;
+const int stat_Move_PushedInput = 176;
+const int stat_Cast_ListCastElement = 177;
+const int stat_Cast_PushFrameWithInputs = 178;
+const int stat_Cast_FinishFrame = 179;
+const int stat_Touch_ListCast = 180;
+const int stat_ValueCreates = 181;
+const int stat_ValueCopies = 182;
+const int stat_ValueCast = 183;
+const int stat_ValueCastDispatched = 184;
+const int stat_ValueTouch = 185;
+const int stat_ListsCreated = 186;
+const int stat_ListsGrown = 187;
+const int stat_ListSoftCopy = 188;
+const int stat_ListHardCopy = 189;
+const int stat_ListTrieNodeCopy = 190;
+const int stat_ListPack = 191;
+const int stat_ListUnpack = 192;
+const int stat_DictHardCopy = 193;
+const int stat_HashtableSoftCopy = 194;
+const int stat_HashtableNodeCopy = 195;
+const int stat_StringCreate = 196;
+const int stat_StringDuplicate = 197;
+const int stat_StringResizeInPlace = 198;
+const int stat_StringBufferGrow = 199;
+const int stat_StringResizeCreate = 200;
+const int stat_StringSoftCopy = 201;
+const int stat_StringToStd = 202;
+const int stat_StepInterpreter = 203;
+const int stat_InterpreterCastOutputFromFinishedFrame = 204;
+const int stat_BlockNameLookups = 205;
+const int stat_PushFrame = 206;
+const int stat_CallNative = 207;
+const int stat_TailCall = 208;
+const int stat_GetFieldByIndex = 209;
+const int stat_SetFieldByIndex = 210;
+const int stat_LoopFinishIteration = 211;
+const int stat_LoopWriteOutput = 212;
+const int stat_WriteTermBytecode = 213;
+const int stat_GcStep = 214;
+const int stat_GcCycle = 215;
+const int stat_GcObjectFreed = 216;
+const int stat_GcPauseMicros = 217;
+const int stat_GcMaxPauseMicros = 218;
+const int stat_GcMinorCollect = 219;
+const int stat_GcPromoted = 220;
+const int stat_FileWatchMtimeCheck = 221;
+const int stat_FileWatchEvent = 222;
+const int stat_DynamicCall = 223;
+const int stat_FinishDynamicCall = 224;
+const int stat_DynamicMethodCall = 225;
+const int stat_SetIndex = 226;
+const int stat_SetField = 227;
+const int name_LastStatIndex = 228;
+const int name_LastBuiltinName = 229;
 
 const char* builtin_name_to_string(int name);
 int builtin_name_from_string(const char* str);
@@ -40,7 +40,9 @@ CircaObject* alloc_object(Type* type, size_t objectSize)
     obj->prev = NULL;
     obj->root = true;
     obj->referenced = false;
-    obj->gcColor = 0;
+    obj->young = false;
+    obj->remembered = false;
+    obj->gcIndex = 0;
     
     return obj;
 }
@@ -21,10 +21,19 @@ struct CircaObject
     // If we're 'root', then we can only be deleted manually, not by GC.
     bool root;
 
+    // If we're 'young', then we're in the nursery, and haven't survived a minor
+    // collection yet.
+    bool young;
+
+    // If we're 'remembered', then we're an old object in the GC remembered set, because
+    // we might hold a reference to a young object.
+    bool remembered;
+
     int refcount;
 
-    // Used during GC collection
-    GCColor gcColor;
+    // Index of this object's mark bit, used during GC collection. 0 if the object isn't
+    // registered with the collector.
+    int gcIndex;
 
     // The object's body will be contiguous in memory.
     char body[0];
@@ -17,12 +17,55 @@
 
 namespace circa {
 
+// Heap-allocated string data. 'length' is always the position of the terminating
+// NUL. 'capacity' is the number of characters that fit before the buffer must be
+// reallocated; a string that is being appended to is given extra room, so that
+// building a string one piece at a time is amortized O(1) per append. 'hash' is
+// computed on first use by string_hash, and is 0 if it's not known yet.
 struct StringData {
     int refCount;
     int length;
+    int capacity;
+    unsigned hash;
     char str[0];
 };
 
+// Small strings
+//
+// When CIRCA_ENABLE_SMALL_STRINGS is on, a string that is short enough is stored
+// directly in the caValue's data field. The first byte holds (length << 1) | 1, and the
+// characters (plus a NUL) follow it. Heap pointers are always aligned, so a set low bit
+// can't be confused with a StringData pointer.
+//
+// A NULL pointer is also a valid string, it means "".
+
+#if CIRCA_ENABLE_SMALL_STRINGS
+const int SmallStringCapacity = (int) sizeof(caValueData) - 2;
+#else
+const int SmallStringCapacity = -1;
+#endif
+
+static inline unsigned char* small_string_bytes(caValue* value)
+{
+    return (unsigned char*) &value->value_data;
+}
+
+static inline bool string_is_small(caValue* value)
+{
+#if CIRCA_ENABLE_SMALL_STRINGS
+    return (small_string_bytes(value)[0] & 1) != 0;
+#else
+    return false;
+#endif
+}
+
+static inline StringData* string_heap_data(caValue* value)
+{
+    if (string_is_small(value))
+        return NULL;
+    return (StringData*) value->value_data.ptr;
+}
+
 void incref(StringData* data)
 {
     data->refCount++;
@@ -37,18 +80,35 @@ void decref(StringData* data)
     }
 }
 
-// Create a new blank string with the given length. Starts off with 1 ref.
-StringData* string_create(int length)
+// Create a new blank string with the given length and capacity. Starts off with 1 ref.
+StringData* string_create(int length, int capacity)
 {
     INCREMENT_STAT(StringCreate);
 
-    StringData* result = (StringData*) malloc(sizeof(StringData) + length + 1);
+    ca_assert(capacity >= length);
+
+    StringData* result = (StringData*) malloc(sizeof(StringData) + capacity + 1);
     result->refCount = 1;
     result->length = length;
+    result->capacity = capacity;
+    result->hash = 0;
     result->str[0] = 0;
+    result->str[length] = 0;
     return result;
 }
 
+StringData* string_create(int length)
+{
+    return string_create(length, length);
+}
+
+// Capacity to use when a string grows from 'capacity' to hold 'length' characters.
+static int string_grown_capacity(int capacity, int length)
+{
+    int grown = capacity + capacity / 2;
+    return grown > length ? grown : length;
+}
+
 // Creates a hard duplicate of a string. Starts off with 1 ref.
 StringData* string_duplicate(StringData* original)
 {
@@ -56,6 +116,7 @@ StringData* string_duplicate(StringData* original)
 
     StringData* dup = string_create(original->length);
     memcpy(dup->str, original->str, original->length + 1);
+    dup->hash = original->hash;
     return dup;
 }
 
@@ -84,24 +145,48 @@ void string_resize(StringData** data, int newLength)
     if ((*data)->refCount == 1) {
         INCREMENT_STAT(StringResizeInPlace);
 
-        // Modify in-place
-        *data = (StringData*) realloc(*data, sizeof(StringData) + newLength + 1);
+        // Modify in-place. The buffer is only reallocated when it runs out of room.
+        if (newLength > (*data)->capacity) {
+            INCREMENT_STAT(StringBufferGrow);
+            int capacity = string_grown_capacity((*data)->capacity, newLength);
+            *data = (StringData*) realloc(*data, sizeof(StringData) + capacity + 1);
+            (*data)->capacity = capacity;
+        }
         (*data)->length = newLength;
+        (*data)->hash = 0;
+        (*data)->str[newLength] = 0;
         return;
     }
 
     INCREMENT_STAT(StringResizeCreate);
 
     StringData* oldData = *data;
-    StringData* newData = string_create(newLength);
-    memcpy(newData->str, oldData->str, oldData->length + 1);
+    StringData* newData = newLength > oldData->length
+        ? string_create(newLength, string_grown_capacity(oldData->length, newLength))
+        : string_create(newLength);
+    int keep = oldData->length < newLength ? oldData->length : newLength;
+    memcpy(newData->str, oldData->str, keep);
     decref(oldData);
     *data = newData;
 }
 
-int string_length(StringData* data)
+// Set up storage for a string of 'length' characters, and return the address of the
+// first character. 'value' must already be an empty String. The string is NUL terminated
+// at 'length', and the caller is expected to fill in the characters before it.
+static char* string_init_storage(caValue* value, int length)
 {
-    return (int) strlen(data->str);
+    ca_assert(value->value_data.ptr == NULL);
+
+    if (length <= SmallStringCapacity) {
+        unsigned char* bytes = small_string_bytes(value);
+        bytes[0] = (unsigned char) ((length << 1) | 1);
+        bytes[1 + length] = 0;
+        return (char*) bytes + 1;
+    }
+
+    StringData* data = string_create(length);
+    value->value_data.ptr = data;
+    return data->str;
 }
 
 // Tagged-value wrappers
@@ -112,44 +197,72 @@ void string_initialize(Type* type, caValue* value)
 
 void string_release(caValue* value)
 {
-    if (value->value_data.ptr == NULL)
+    StringData* data = string_heap_data(value);
+    if (data == NULL)
         return;
-    decref((StringData*) value->value_data.ptr);
+    decref(data);
 }
 
 void string_copy(Type* type, caValue* source, caValue* dest)
 {
     set_null(dest);
-    StringData* data = (StringData*) source->value_data.ptr;
+    StringData* data = string_heap_data(source);
     if (data != NULL)
         incref(data);
     dest->value_type = source->value_type;
-    dest->value_data.ptr = data;
+    dest->value_data = source->value_data;
 
     INCREMENT_STAT(StringSoftCopy);
 }
 
 void string_reset(caValue* val)
 {
-    StringData* data = (StringData*) val->value_data.ptr;
-    if (data != NULL)
-        decref(data);
+    string_release(val);
     val->value_data.ptr = NULL;
 }
 
-int string_hash(caValue* val)
+// String hashing is FNV-1a, followed by the MurmurHash3 finalizer so that every input
+// bit affects the low bits (which are used to pick a slot).
+static unsigned hash_finalize(unsigned hash)
 {
-    const char* str = as_cstring(val);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
 
-    // Dumb and simple hash function
-    int result = 0;
-    int byte = 0;
-    while (*str != 0) {
-        result = result ^ (*str << (8 * byte));
-        byte = (byte + 1) % 4;
-        str++;
+unsigned hash_cstring(const char* str)
+{
+    unsigned hash = 2166136261u;
+    for (const char* c = str; *c != 0; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 16777619u;
     }
-    return result;
+    return hash_finalize(hash);
+}
+
+unsigned hash_string_range(const char* str, int length)
+{
+    unsigned hash = 2166136261u;
+    for (int i=0; i < length; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash_finalize(hash);
+}
+
+int string_hash(caValue* val)
+{
+    StringData* data = string_heap_data(val);
+    if (data == NULL)
+        return (int) hash_string_range(as_cstring(val), string_length(val));
+
+    // A computed hash of 0 isn't cached, it's just recomputed each time.
+    if (data->hash == 0)
+        data->hash = hash_string_range(data->str, data->length);
+    return (int) data->hash;
 }
 
 bool string_equals(caValue* left, caValue* right)
@@ -157,30 +270,33 @@ bool string_equals(caValue* left, caValue* right)
     if (!is_string(right))
         return false;
 
-    // Shortcut, check if objects are the same.
+    // Shortcut, check if objects are the same. This also catches identical small strings.
     if (left->value_data.ptr == right->value_data.ptr)
         return true;
 
-    if (left->value_data.ptr == NULL)
+    int length = string_length(left);
+    if (length != string_length(right))
         return false;
 
-    StringData* leftData = (StringData*) left->value_data.ptr;
-    StringData* rightData = (StringData*) right->value_data.ptr;
+    StringData* leftData = string_heap_data(left);
+    StringData* rightData = string_heap_data(right);
 
-    for (int i=0;; i++) {
-        if (leftData->str[i] != rightData->str[i])
-            return false;
-        if (leftData->str[i] == 0)
-            break;
-    }
+    if (leftData != NULL && rightData != NULL
+            && leftData->hash != 0 && rightData->hash != 0
+            && leftData->hash != rightData->hash)
+        return false;
+
+    if (memcmp(as_cstring(left), as_cstring(right), length) != 0)
+        return false;
 
     // Strings are equal. Sneakily have both values reference the same data.
     // Prefer to preserve the one that has more references.
-    if (leftData->refCount >= rightData->refCount)
-        string_copy(NULL, right, left);
-    else
-        string_copy(NULL, left, right);
-
+    if (leftData != NULL && rightData != NULL) {
+        if (leftData->refCount >= rightData->refCount)
+            string_copy(NULL, right, left);
+        else
+            string_copy(NULL, left, right);
+    }
 
     return true;
 }
@@ -229,6 +345,8 @@ void string_setup_type(Type* type)
 const char* as_cstring(caValue* value)
 {
     ca_assert(value->value_type->storageType == name_StorageTypeString);
+    if (string_is_small(value))
+        return (const char*) small_string_bytes(value) + 1;
     StringData* data = (StringData*) value->value_data.ptr;
     if (data == NULL)
         return "";
@@ -239,15 +357,22 @@ void string_append(caValue* left, const char* right)
 {
     ca_assert(is_string(left));
 
-    StringData** data = (StringData**) &left->value_data.ptr;
-    
-    int leftLength = string_length(*data);
+    int leftLength = string_length(left);
+
+    // 'right' may point into 'left' (see as_cstring), and resizing 'left' would overwrite
+    // or free it.
+    const char* leftStr = as_cstring(left);
+    if (right >= leftStr && right <= leftStr + leftLength) {
+        std::string saved(right);
+        string_append(left, saved.c_str());
+        return;
+    }
+
     int rightLength = (int) strlen(right);
-    int newLength = leftLength + rightLength;
 
-    string_resize(data, newLength);
+    string_resize(left, leftLength + rightLength);
 
-    memcpy((*data)->str + leftLength, right, rightLength + 1);
+    memcpy((char*) as_cstring(left) + leftLength, right, rightLength);
 }
 
 void string_append(caValue* left, caValue* right)
@@ -299,8 +424,31 @@ void string_resize(caValue* s, int length)
     if (length < 0)
         length = string_length(s) + length;
 
-    StringData** data = (StringData**) &s->value_data.ptr;
-    string_resize(data, length);
+    StringData* data = string_heap_data(s);
+
+    if (data != NULL && length > SmallStringCapacity) {
+        string_resize((StringData**) &s->value_data.ptr, length);
+        return;
+    }
+
+    // Changing to or from a small string. Save the existing characters, then rebuild
+    // the storage.
+    int oldLength = string_length(s);
+    int keep = oldLength < length ? oldLength : length;
+
+    char smallBuf[sizeof(caValueData)];
+    const char* existing = as_cstring(s);
+    if (data == NULL) {
+        memcpy(smallBuf, existing, keep);
+        existing = smallBuf;
+    }
+
+    s->value_data.ptr = NULL;
+    char* str = string_init_storage(s, length);
+    memcpy(str, existing, keep);
+
+    if (data != NULL)
+        decref(data);
 }
 bool string_eq(caValue* s, const char* str)
 {
@@ -348,7 +496,12 @@ char string_get(caValue* s, int index)
 
 int string_length(caValue* s)
 {
-    return string_length((StringData*) s->value_data.ptr);
+    if (string_is_small(s))
+        return small_string_bytes(s)[0] >> 1;
+    StringData* data = (StringData*) s->value_data.ptr;
+    if (data == NULL)
+        return 0;
+    return data->length;
 }
 
 void string_slice(caValue* s, int start, int end, caValue* out)
@@ -362,12 +515,7 @@ void string_slice(caValue* s, int start, int end, caValue* out)
     if (end == -1)
         end = string_length(s);
 
-    int len = end - start;
-    string_resize(out, len);
-
-    StringData* data = (StringData*) s->value_data.ptr;
-
-    set_string(out, data->str + start, len);
+    set_string(out, as_cstring(s) + start, end - start);
 }
 
 int string_find_char(caValue* s, int start, char c)
@@ -413,27 +561,29 @@ std::string as_string(caValue* value)
 char* string_initialize(caValue* value, int length)
 {
     make(TYPES.string, value);
-    StringData* data = string_create(length);
-    value->value_data.ptr = data;
-    return data->str;
+    return string_init_storage(value, length);
 }
 
 void set_string(caValue* value, const char* s)
 {
-    make(TYPES.string, value);
-    int length = strlen(s);
-    StringData* data = string_create(length);
-    memcpy(data->str, s, length + 1);
-    value->value_data.ptr = data;
+    set_string(value, s, (int) strlen(s));
 }
 
 void set_string(caValue* value, const char* s, int length)
 {
+    // 's' may point into 'value' (see as_cstring), so save it before 'value' is reset.
+    if (is_string(value)) {
+        const char* existing = as_cstring(value);
+        if (s >= existing && s <= existing + string_length(value)) {
+            std::string saved(s, length);
+            set_string(value, saved.c_str(), length);
+            return;
+        }
+    }
+
     make(TYPES.string, value);
-    StringData* data = string_create(length);
-    memcpy(data->str, s, length);
-    data->str[length] = 0;
-    value->value_data.ptr = data;
+    char* str = string_init_storage(value, length);
+    memcpy(str, s, length);
 }
 
 char* circa_strdup(const char* s)
@@ -34,8 +34,20 @@ void string_slice(caValue* s, int start, int end, caValue* out);
 int string_find_char(caValue* s, int start, char c);
 int string_find_char_from_end(caValue* s, char c);
 
+// Hash function for strings, used by string_hash and by Dict.
+unsigned hash_cstring(const char* str);
+
+// Same hash as hash_cstring, for the first 'length' characters of 'str'.
+unsigned hash_string_range(const char* str, int length);
+
 void string_split(caValue* s, char sep, caValue* listOut);
 
+// Returns the string's characters. A short string is stored inline, so the result may
+// point into 'value' itself rather than into a heap buffer. The pointer is only valid
+// until 'value' is modified or moved: for example by set_string or string_append on it,
+// by move() or swap(), or by anything that reallocates the storage that holds 'value'
+// (such as list_append on its containing list, or a resize of a frame's registers).
+// Copy the string first if it needs to outlive any of those.
 const char* as_cstring(caValue* value);
 
 // Initialize a string with the given length, and return the address. This value
@@ -7,6 +7,7 @@
 #include "function.h"
 #include "importing_macros.h"
 #include "kernel.h"
+#include "list.h"
 #include "inspection.h"
 #include "parser.h"
 #include "source_repro.h"
@@ -114,6 +115,7 @@ Type::Type()
 
 Type::~Type()
 {
+    list_type_free_field_index(this);
     gc_on_object_deleted((CircaObject*) this);
 }
 
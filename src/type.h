@@ -106,6 +106,9 @@ struct Type
     // Flag, if true then at least one value has been created using this type.
     bool inUse;
 
+    // Cached field name lookup for struct types, owned by list.cpp. May be NULL.
+    FieldIndexTable* fieldIndexTable;
+
     Type();
     ~Type();
 
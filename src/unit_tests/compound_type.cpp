@@ -26,9 +26,35 @@ void build_compound_type()
     test_assert(compound_type_get_field_type(type, 1) == TYPES.int_type);
 }
 
+void find_field_index()
+{
+    Type* type = create_compound_type();
+
+    test_equals(list_find_field_index_by_name(type, "a"), -1);
+
+    compound_type_append_field(type, TYPES.int_type, "a");
+    compound_type_append_field(type, TYPES.int_type, "b");
+    test_equals(list_find_field_index_by_name(type, "a"), 0);
+    test_equals(list_find_field_index_by_name(type, "b"), 1);
+    test_equals(list_find_field_index_by_name(type, "c"), -1);
+
+    // Fields added after a lookup are found.
+    char name[8];
+    for (int i=0; i < 40; i++) {
+        sprintf(name, "f%d", i);
+        compound_type_append_field(type, TYPES.int_type, name);
+    }
+
+    test_equals(list_find_field_index_by_name(type, "b"), 1);
+    test_equals(list_find_field_index_by_name(type, "f0"), 2);
+    test_equals(list_find_field_index_by_name(type, "f39"), 41);
+    test_equals(list_find_field_index_by_name(type, "f40"), -1);
+}
+
 void register_tests()
 {
     REGISTER_TEST_CASE(build_compound_type);
+    REGISTER_TEST_CASE(find_field_index);
 }
 
 }
@@ -0,0 +1,137 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "unit_test_common.h"
+
+#include "dict.h"
+#include "string_type.h"
+
+namespace dict_tests {
+
+void insert_and_get()
+{
+    Dict dict;
+    dict.setInt("a", 1);
+    dict.setInt("b", 2);
+    dict.setString("a_key_that_is_too_long_to_store_inline", "long");
+
+    test_equals(dict.getInt("a", 0), 1);
+    test_equals(dict.getInt("b", 0), 2);
+    test_equals(dict.getString("a_key_that_is_too_long_to_store_inline", ""), "long");
+    test_assert(!dict.contains("c"));
+
+    dict.setInt("a", 3);
+    test_equals(dict.getInt("a", 0), 3);
+    test_equals(dict.toString(),
+        "{a: 3, a_key_that_is_too_long_to_store_inline: 'long', b: 2}");
+}
+
+void many_keys_with_common_prefix()
+{
+    Dict dict;
+    char key[64];
+    for (int i=0; i < 2000; i++) {
+        sprintf(key, "some_common_prefix_%d", i);
+        dict.setInt(key, i);
+    }
+
+    for (int i=0; i < 2000; i++) {
+        sprintf(key, "some_common_prefix_%d", i);
+        test_equals(dict.getInt(key, -1), i);
+    }
+
+    test_assert(!dict.contains("some_common_prefix_2000"));
+}
+
+void remove_and_reinsert()
+{
+    Dict dict;
+    char key[64];
+    for (int i=0; i < 500; i++) {
+        sprintf(key, "k%d", i);
+        dict.setInt(key, i);
+    }
+
+    // Remove every other key.
+    for (int i=0; i < 500; i += 2) {
+        sprintf(key, "k%d", i);
+        dict.remove(key);
+    }
+
+    for (int i=0; i < 500; i++) {
+        sprintf(key, "k%d", i);
+        test_equals(dict.contains(key), i % 2 == 1);
+    }
+
+    // Churn through lots of insert/remove pairs, which leaves deleted slots behind.
+    for (int i=0; i < 5000; i++) {
+        sprintf(key, "temp%d", i);
+        dict.setInt(key, i);
+        dict.remove(key);
+    }
+
+    for (int i=1; i < 500; i += 2) {
+        sprintf(key, "k%d", i);
+        test_equals(dict.getInt(key, -1), i);
+    }
+}
+
+void iterate()
+{
+    Dict dict;
+    char key[64];
+    for (int i=0; i < 100; i++) {
+        sprintf(key, "k%d", i);
+        dict.setInt(key, i);
+    }
+
+    // Delete odd values during iteration.
+    Value it;
+    for (dict.iteratorStart(&it); !dict.iteratorFinished(&it); dict.iteratorNext(&it)) {
+        const char* itKey;
+        caValue* value;
+        dict.iteratorGet(&it, &itKey, &value);
+        if (as_int(value) % 2 == 1)
+            dict.iteratorDelete(&it);
+    }
+
+    int count = 0;
+    int sum = 0;
+    for (dict.iteratorStart(&it); !dict.iteratorFinished(&it); dict.iteratorNext(&it)) {
+        const char* itKey;
+        caValue* value;
+        dict.iteratorGet(&it, &itKey, &value);
+        sprintf(key, "k%d", as_int(value));
+        test_equals(itKey, key);
+        count++;
+        sum += as_int(value);
+    }
+
+    test_equals(count, 50);
+    test_equals(sum, 2450);
+}
+
+void copy_is_independent()
+{
+    Dict dict;
+    dict.setInt("a", 1);
+
+    Dict dupe;
+    copy(&dict, &dupe);
+    dupe.setInt("a", 2);
+    dupe.setInt("b", 3);
+
+    test_equals(dict.getInt("a", 0), 1);
+    test_assert(!dict.contains("b"));
+    test_equals(dupe.getInt("a", 0), 2);
+}
+
+void register_tests()
+{
+    REGISTER_TEST_CASE(dict_tests::insert_and_get);
+    REGISTER_TEST_CASE(dict_tests::many_keys_with_common_prefix);
+    REGISTER_TEST_CASE(dict_tests::remove_and_reinsert);
+    REGISTER_TEST_CASE(dict_tests::iterate);
+    REGISTER_TEST_CASE(dict_tests::copy_is_independent);
+}
+
+} // namespace dict_tests
@@ -2,12 +2,18 @@
 
 #include "unit_test_common.h"
 
+#include "debug.h"
 #include "fakefs.h"
+#include "file.h"
 #include "file_watch.h"
 #include "kernel.h"
 #include "modules.h"
 #include "world.h"
 
+#if CIRCA_ENABLE_INOTIFY
+#include <unistd.h>
+#endif
+
 namespace file_watch {
 
 void test_simple()
@@ -71,10 +77,66 @@ void test_check_all_watches()
     test_equals(term_value(find_from_global_name(world, "file_block:x")), "3");
 }
 
+#if CIRCA_ENABLE_INOTIFY
+void test_inotify_events()
+{
+    World* world = global_world();
+
+    // Use a separate set of watches, since the earlier tests leave polled watches behind.
+    FileWatchWorld* savedFileWatchWorld = world->fileWatchWorld;
+    world->fileWatchWorld = create_file_watch_world();
+
+    char filename[100];
+    sprintf(filename, "/tmp/circa_file_watch_test_%d.ca", (int) getpid());
+    write_text_file(filename, "x = 1");
+
+    add_file_watch_module_load(world, filename, "inotify_block");
+    file_watch_trigger_actions(world, filename);
+    test_equals(term_value(find_from_global_name(world, "inotify_block:x")), "1");
+
+    // The change is found from its event, even if the mtime didn't advance.
+    write_text_file(filename, "x = 2");
+    file_watch_check_all(world);
+    test_equals(term_value(find_from_global_name(world, "inotify_block:x")), "2");
+
+    // Without any events, the file isn't checked again.
+    perf_stats_reset();
+    file_watch_check_all(world);
+    test_equals(term_value(find_from_global_name(world, "inotify_block:x")), "2");
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(PERF_STATS[stat_FileWatchMtimeCheck - c_firstStatIndex], 0);
+#endif
+
+    unlink(filename);
+
+    destroy_file_watch_world(world->fileWatchWorld);
+    world->fileWatchWorld = savedFileWatchWorld;
+}
+
+void test_destroy_closes_inotify()
+{
+    // Descriptors are allocated lowest-first, so a leaked inotify descriptor would
+    // show up as a higher number here.
+    int before = dup(0);
+    close(before);
+
+    FileWatchWorld* fileWatchWorld = create_file_watch_world();
+    destroy_file_watch_world(fileWatchWorld);
+
+    int after = dup(0);
+    close(after);
+    test_equals(after, before);
+}
+#endif
+
 void register_tests()
 {
     REGISTER_TEST_CASE(file_watch::test_simple);
     REGISTER_TEST_CASE(file_watch::test_check_all_watches);
+#if CIRCA_ENABLE_INOTIFY
+    REGISTER_TEST_CASE(file_watch::test_inotify_events);
+    REGISTER_TEST_CASE(file_watch::test_destroy_closes_inotify);
+#endif
 }
 
 }
@@ -0,0 +1,233 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "unit_test_common.h"
+
+#include "block.h"
+#include "building.h"
+#include "debug.h"
+#include "gc.h"
+#include "kernel.h"
+#include "type.h"
+
+namespace gc_tests {
+
+// The collector doesn't trace references that are held inside values yet, so a cycle
+// during a test would free kernel objects that are still in use. Each test pins every
+// object that already exists, and only its own objects can be collected.
+struct PinExistingObjects
+{
+    GCReferenceList objects;
+    std::vector<bool> wasRoot;
+
+    PinExistingObjects()
+    {
+        gc_list_live_objects(&objects);
+        for (int i=0; i < objects.count; i++) {
+            wasRoot.push_back(objects.refs[i]->root);
+            gc_set_object_is_root(objects.refs[i], true);
+        }
+    }
+    ~PinExistingObjects()
+    {
+        for (int i=0; i < objects.count; i++)
+            gc_set_object_is_root(objects.refs[i], wasRoot[i]);
+    }
+};
+
+bool is_live(void* object)
+{
+    GCReferenceList live;
+    gc_list_live_objects(&live);
+    for (int i=0; i < live.count; i++)
+        if (live.refs[i] == object)
+            return true;
+    return false;
+}
+
+void full_collect()
+{
+    PinExistingObjects pin;
+
+    Block* block = new Block();
+    Term* term = create_value(block, TYPES.int_type);
+
+    Type* used = create_type();
+    Type* unused = create_type();
+    change_declared_type(term, used);
+
+    gc_collect();
+    test_assert(!gc_is_collecting());
+    test_assert(is_live(used));
+    test_assert(!is_live(unused));
+
+    delete block;
+    gc_collect();
+    test_assert(!is_live(used));
+}
+
+void incremental_cycle()
+{
+    PinExistingObjects pin;
+
+    Block* block = new Block();
+    Term* term = create_value(block, TYPES.int_type);
+    Type* storedLater = create_type();
+    Type* deletedDuringCycle = create_type();
+    gc_set_object_is_root((CircaObject*) deletedDuringCycle, true);
+
+    perf_stats_reset();
+
+    // A zero budget does a single chunk of work, which isn't enough for the whole heap.
+    test_assert(!gc_step(0));
+    test_assert(gc_is_collecting());
+
+    // Mutate the heap in the middle of the cycle: store a reference to an object that
+    // existed before the cycle, create a new one, and delete one that may be gray.
+    change_declared_type(term, storedLater);
+    Type* createdDuringCycle = create_type();
+    delete deletedDuringCycle;
+
+    int steps = 1;
+    do {
+        steps++;
+    } while (!gc_step(0));
+
+    test_assert(steps > 1);
+    test_assert(!gc_is_collecting());
+    test_assert(is_live(storedLater));
+    test_assert(is_live(createdDuringCycle));
+    test_assert(gc_sanity_check_live_objects());
+
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(PERF_STATS[stat_GcCycle - c_firstStatIndex], 1);
+    test_equals(PERF_STATS[stat_GcStep - c_firstStatIndex], steps);
+#endif
+
+    // Nothing references the new object, so the next cycle releases it.
+    gc_collect();
+    test_assert(!is_live(createdDuringCycle));
+    test_assert(is_live(storedLater));
+
+    delete block;
+    gc_collect();
+}
+
+void minor_collection()
+{
+    PinExistingObjects pin;
+
+    // Promote everything that exists so far, including this block.
+    Block* block = new Block();
+    Term* term = create_value(block, TYPES.int_type);
+    gc_minor_collect();
+    test_equals(gc_count_young_objects(), 0);
+    test_assert(!block->header.young);
+
+    perf_stats_reset();
+
+    // Storing a young object in the old block puts the block in the remembered set, so
+    // the young object survives without the old list being walked.
+    Type* stored = create_type();
+    Type* unused = create_type();
+    change_declared_type(term, stored);
+    test_assert(block->header.remembered);
+    test_equals(gc_count_young_objects(), 2);
+
+    gc_minor_collect();
+    test_assert(is_live(stored));
+    test_assert(!is_live(unused));
+    test_assert(!((CircaObject*) stored)->young);
+    test_assert(!block->header.remembered);
+    test_equals(gc_count_young_objects(), 0);
+    test_assert(gc_sanity_check_live_objects());
+
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(PERF_STATS[stat_GcMinorCollect - c_firstStatIndex], 1);
+    test_equals(PERF_STATS[stat_GcPromoted - c_firstStatIndex], 1);
+#endif
+
+    delete block;
+    gc_collect();
+    test_assert(!is_live(stored));
+}
+
+// Objects for the benchmark: a header plus a pointer to the next object in a chain.
+struct BenchObject
+{
+    CircaObject header;
+    BenchObject* next;
+};
+
+void bench_list_references(CircaObject* object, GCReferenceList* list, GCColor color)
+{
+    gc_mark(list, (CircaObject*) ((BenchObject*) object)->next, color);
+}
+
+void bench_release(CircaObject* object)
+{
+    free(object);
+}
+
+double elapsed_ms(clock_t start)
+{
+    return (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+void mark_sweep_benchmark()
+{
+    PinExistingObjects pin;
+    int liveBefore = gc_count_live_objects();
+
+    Type* benchType = create_type();
+    gc_set_object_is_root((CircaObject*) benchType, true);
+    benchType->gcListReferences = bench_list_references;
+    benchType->gcRelease = bench_release;
+
+    // Half of the objects form a chain that's reachable from one root, the other half
+    // are garbage.
+    const int count = 1000000;
+    BenchObject* head = NULL;
+    for (int i=0; i < count; i++) {
+        BenchObject* object = (BenchObject*) malloc(sizeof(BenchObject));
+        gc_register_new_object(&object->header, benchType, false);
+        object->next = NULL;
+        if (i % 2 == 0) {
+            object->next = head;
+            head = object;
+        }
+    }
+    gc_set_object_is_root(&head->header, true);
+
+    // The first collection marks the chain and frees the garbage.
+    clock_t start = clock();
+    gc_collect();
+    double firstMs = elapsed_ms(start);
+    test_equals(gc_count_live_objects(), liveBefore + 1 + count / 2);
+
+    // The second one only marks, everything left is reachable.
+    start = clock();
+    gc_collect();
+    double markMs = elapsed_ms(start);
+    test_equals(gc_count_live_objects(), liveBefore + 1 + count / 2);
+
+    gc_set_object_is_root(&head->header, false);
+    start = clock();
+    gc_collect();
+    double sweepMs = elapsed_ms(start);
+    test_equals(gc_count_live_objects(), liveBefore + 1);
+
+    printf("gc benchmark, %d objects: mark+sweep half %.1fms, mark all %.1fms, "
+        "sweep all %.1fms\n", count, firstMs, markMs, sweepMs);
+
+    delete benchType;
+}
+
+void register_tests()
+{
+    REGISTER_TEST_CASE(gc_tests::full_collect);
+    REGISTER_TEST_CASE(gc_tests::incremental_cycle);
+    REGISTER_TEST_CASE(gc_tests::minor_collection);
+    REGISTER_BENCHMARK(gc_tests::mark_sweep_benchmark);
+}
+
+} // namespace gc_tests
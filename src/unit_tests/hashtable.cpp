@@ -0,0 +1,106 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "unit_test_common.h"
+
+#include "debug.h"
+#include "hashtable.h"
+
+namespace hashtable_tests {
+
+void insert_get_remove()
+{
+    Value table;
+    set_hashtable(&table);
+
+    Value key;
+    for (int i=0; i < 5000; i++) {
+        set_int(&key, i);
+        set_int(hashtable_insert(&table, &key), i * 2);
+    }
+
+    for (int i=0; i < 5000; i++) {
+        set_int(&key, i);
+        caValue* value = hashtable_get(&table, &key);
+        test_assert(value != NULL);
+        test_equals(as_int(value), i * 2);
+    }
+
+    for (int i=0; i < 5000; i += 2) {
+        set_int(&key, i);
+        hashtable_remove(&table, &key);
+    }
+
+    for (int i=0; i < 5000; i++) {
+        set_int(&key, i);
+        test_equals(hashtable_get(&table, &key) != NULL, i % 2 == 1);
+    }
+
+    set_int(&key, 5000);
+    test_assert(hashtable_get(&table, &key) == NULL);
+}
+
+void string_keys()
+{
+    Value table;
+    set_hashtable(&table);
+
+    Value key;
+    char buf[32];
+    for (int i=0; i < 1000; i++) {
+        sprintf(buf, "key%d", i);
+        set_string(&key, buf);
+        set_int(hashtable_insert(&table, &key), i);
+    }
+
+    for (int i=0; i < 1000; i++) {
+        sprintf(buf, "key%d", i);
+        set_string(&key, buf);
+        test_equals(as_int(hashtable_get(&table, &key)), i);
+    }
+}
+
+void copies_share_structure()
+{
+    Value table;
+    set_hashtable(&table);
+
+    Value key;
+    for (int i=0; i < 5000; i++) {
+        set_int(&key, i);
+        set_int(hashtable_insert(&table, &key), i);
+    }
+
+    Value copy1;
+    copy(&table, &copy1);
+
+    // Updating one key of the copy should only copy the nodes on that key's path.
+    perf_stats_reset();
+    set_int(&key, 100);
+    set_int(hashtable_insert(&copy1, &key), -1);
+
+#if CIRCA_ENABLE_PERF_STATS
+    int nodeCopies = int(PERF_STATS[stat_HashtableNodeCopy - c_firstStatIndex]);
+    test_assert(nodeCopies > 0 && nodeCopies <= 4);
+#endif
+
+    test_equals(as_int(hashtable_get(&table, &key)), 100);
+    test_equals(as_int(hashtable_get(&copy1, &key)), -1);
+
+    // Removing from the original leaves the copy alone.
+    hashtable_remove(&table, &key);
+    test_assert(hashtable_get(&table, &key) == NULL);
+    test_equals(as_int(hashtable_get(&copy1, &key)), -1);
+
+    set_int(&key, 101);
+    test_equals(as_int(hashtable_get(&table, &key)), 101);
+    test_equals(as_int(hashtable_get(&copy1, &key)), 101);
+}
+
+void register_tests()
+{
+    REGISTER_TEST_CASE(hashtable_tests::insert_get_remove);
+    REGISTER_TEST_CASE(hashtable_tests::string_keys);
+    REGISTER_TEST_CASE(hashtable_tests::copies_share_structure);
+}
+
+} // namespace hashtable_tests
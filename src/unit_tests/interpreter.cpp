@@ -3,13 +3,16 @@
 #include "unit_test_common.h"
 
 #include "block.h"
+#include "building.h"
 #include "evaluation.h"
 #include "kernel.h"
 #include "fakefs.h"
 #include "function.h"
 #include "importing.h"
 #include "modules.h"
+#include "string_type.h"
 #include "type.h"
+#include "update_cascades.h"
 #include "world.h"
 
 namespace interpreter {
@@ -105,12 +108,344 @@ void test_directly_call_native_override()
     test_equals(circa_output(&stack, 0), "15");
 }
 
+void test_packed_bytecode()
+{
+    Block block;
+    block.compile("def f(int a, int b) -> int { return a + b }");
+    Term* a = block.compile("a = 1");
+    block.compile("b = f(a, 2)");
+    block_finish_changes(&block);
+
+    Bytecode* bytecode = block.packedBytecode;
+
+    // One op per term, plus the finish op.
+    test_equals(bytecode->opCount, block.length() + 1);
+
+    BytecodeOp* call = bytecode_op(bytecode, block["b"]->index);
+    test_assert(call->op == op_CallBlock);
+    test_assert(call->outputAction == name_FlatOutputs);
+    test_assert(call->block == function_contents(block["f"]));
+    test_equals(call->inputCount, 2);
+
+    BytecodeInput* inputs = bytecode_op_inputs(bytecode, call);
+    test_assert(inputs[0].action == name_Copy);
+    test_assert(inputs[0].term == a);
+    test_equals(inputs[0].registerIndex, a->index);
+
+    BytecodeOp* finish = bytecode_op(bytecode, block.length());
+    test_assert(finish->op == op_FinishFrame);
+}
+
+void test_last_use_inputs_are_moved()
+{
+    Block block;
+    Term* f = block.compile("def f(List l) -> List { a = l.append(1); b = a.append(2); "
+        "return a.concat(b) }");
+    Term* call = block.compile("f([0])");
+    block_finish_changes(&block);
+
+    Block* contents = function_contents(f);
+    Term* a = contents->get("a");
+    Term* b = contents->get("b");
+    Term* concat = b->users[0];
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+    test_equals(get_frame_register(top_frame(&stack), call->index), "[0, 1, 0, 1, 2]");
+
+    Bytecode* bytecode = contents->packedBytecode;
+
+    // 'l' is only used by the first append, so it's moved.
+    BytecodeInput* inputs = bytecode_op_inputs(bytecode, bytecode_op(bytecode, a->index));
+    test_assert(inputs[0].consume);
+    test_assert(!inputs[1].consume);
+
+    // 'a' is used twice, so it's copied both times.
+    inputs = bytecode_op_inputs(bytecode, bytecode_op(bytecode, b->index));
+    test_assert(!inputs[0].consume);
+
+    inputs = bytecode_op_inputs(bytecode, bytecode_op(bytecode, concat->index));
+    test_assert(!inputs[0].consume);
+    test_assert(inputs[1].consume);
+
+    // Module-level values are never moved.
+    bytecode = block.packedBytecode;
+    inputs = bytecode_op_inputs(bytecode, bytecode_op(bytecode, call->index));
+    test_assert(!inputs[0].consume);
+}
+
+void test_module_values_are_not_moved()
+{
+    // A module is run like a REPL session: lines are added to the module block and the
+    // existing stack continues from where it stopped. Earlier values must still be in
+    // their registers.
+    FakeFilesystem fs;
+    fs.set("repl.ca", "a = concat('x' 'y')");
+
+    Block* block = load_module_file(global_world(), "test_module_values_are_not_moved",
+        "repl.ca");
+    test_assert(block->owningTerm != NULL);
+
+    Stack stack;
+    push_frame(&stack, block);
+    run_interpreter(&stack);
+
+    block->compile("b = a.length()");
+    run_interpreter(&stack);
+
+    Term* c = block->compile("c = concat(a 'z')");
+    run_interpreter(&stack);
+
+    test_assert(!stack.errorOccurred);
+    test_equals(get_frame_register(top_frame(&stack), c->index), "xyz");
+}
+
+void test_loop_accumulator_is_unshared()
+{
+    // Appending to a loop-carried list should modify it in place, instead of duplicating
+    // it on every iteration.
+    Block block;
+    block.compile("def build(int n) -> List { result = []; "
+        "for i in 0..n { result = result.append(i) } return result }");
+    Term* call = block.compile("build(50)");
+    block_finish_changes(&block);
+
+    perf_stats_reset();
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+
+    test_assert(!stack.errorOccurred);
+    test_equals(list_length(get_frame_register(top_frame(&stack), call->index)), 50);
+
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(int(PERF_STATS[stat_Copy_ListDuplicate - c_firstStatIndex]), 0);
+#endif
+}
+
+void test_string_append_is_unshared()
+{
+    // String.append also returns the string as its primary output. Nothing reads that
+    // output here, so it's dropped instead of keeping a second reference to the string.
+    Block block;
+    block.compile("def build(int n) -> String { s = ''; "
+        "for i in 0..n { @s.append('ab') } return s }");
+    Term* call = block.compile("build(50)");
+    block_finish_changes(&block);
+
+    perf_stats_reset();
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+
+    test_assert(!stack.errorOccurred);
+    test_equals(string_length(get_frame_register(top_frame(&stack), call->index)), 100);
+
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(int(PERF_STATS[stat_StringResizeCreate - c_firstStatIndex]), 0);
+#endif
+}
+
+void test_static_field_access()
+{
+    Block block;
+    block.compile("type P { int x; number y }");
+    Term* f = block.compile("def f(P p) -> int { p.y = 2.5; p.x + 1 }");
+    Term* call = block.compile("f(make(P))");
+    block_finish_changes(&block);
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+    test_equals(get_frame_register(top_frame(&stack), call->index), "1");
+
+    // Field accesses are resolved to an index. The assignment reads 'p.y' as well.
+    Block* contents = function_contents(f);
+    Bytecode* bytecode = contents->packedBytecode;
+    int reads = 0;
+    int writes = 0;
+    for (int i=0; i < bytecode->opCount; i++) {
+        BytecodeOp* op = bytecode_op(bytecode, i);
+        if (op->op == op_GetField) {
+            reads++;
+        } else if (op->op == op_SetField) {
+            writes++;
+            test_equals(op->fieldIndex, 1);
+        }
+    }
+    test_equals(reads, 2);
+    test_equals(writes, 1);
+}
+
+void test_input_frame_distance()
+{
+    Block block;
+    Term* a = block.compile("a = 1");
+    Term* b = block.compile("b = add(a, 1)");
+    Term* loop = block.compile("for i in [1 2] { c = add(b, i) }");
+    block_finish_changes(&block);
+
+    Block* contents = nested_contents(loop);
+    Term* c = contents->get("c");
+
+    test_equals(bytecode_find_frame_distance(&block, a), FrameDistance_TermValue);
+    test_equals(bytecode_find_frame_distance(&block, b), 0);
+    test_equals(bytecode_find_frame_distance(contents, b), 1);
+    test_equals(bytecode_find_frame_distance(contents, c->input(1)), 0);
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+    test_assert(!stack.errorOccurred);
+}
+
+void test_call_native_inline()
+{
+    Block block;
+    block.compile("a = 1");
+    Term* b = block.compile("b = add(a, 2)");
+    block_finish_changes(&block);
+
+    BytecodeOp* call = bytecode_op(block.packedBytecode, b->index);
+    test_assert(call->op == op_CallNative);
+
+    Stack stack;
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+    test_assert(!stack.errorOccurred);
+    test_equals(as_int(get_frame_register(top_frame(&stack), b)), 3);
+}
+
+void test_frames_share_bytecode()
+{
+    Block block;
+    block.compile("a = 1");
+    block_finish_changes(&block);
+
+    Stack stack;
+    Frame* frame = push_frame(&stack, &block);
+    Bytecode* bytecode = block.packedBytecode;
+    test_assert(frame_bytecode(frame) == bytecode);
+    test_equals(bytecode->refCount, 2);
+
+    // Recompiling the block creates a new object, the frame keeps the old one.
+    dirty_bytecode(&block);
+    refresh_bytecode(&block);
+    test_assert(block.packedBytecode != bytecode);
+    test_assert(frame_bytecode(frame) == bytecode);
+    test_equals(bytecode->refCount, 1);
+}
+
+void test_register_windows()
+{
+    Block block;
+    block.compile("a = 1");
+    block.compile("b = 2");
+    block_finish_changes(&block);
+
+    Stack stack;
+    Frame* first = push_frame(&stack, &block);
+    Frame* second = push_frame(&stack, &block);
+
+    // Each frame is a window into the stack's register arena.
+    test_equals(frame_register_count(first), block.length());
+    test_equals(second->registerFirst, first->registerFirst + first->registerCount);
+    test_equals(stack.registersTop, second->registerFirst + second->registerCount);
+
+    set_int(get_frame_register(second, 0), 5);
+    pop_frame(&stack);
+    test_equals(stack.registersTop, first->registerFirst + first->registerCount);
+
+    // Pushing again reuses the space, which starts out null.
+    second = push_frame(&stack, &block);
+    test_assert(is_null(get_frame_register(second, 0)));
+}
+
+void test_stack_overflow()
+{
+    Block block;
+    block.compile("def f(int i) -> int { return f(i + 1) + 1 }");
+    block.compile("f(0)");
+
+    Stack stack;
+    stack_set_memory_limit(&stack, 100 * 1000);
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+
+    test_assert(stack.errorOccurred);
+    test_assert(stack_memory_usage(&stack) > 100 * 1000);
+
+    Frame* top = top_frame(&stack);
+    test_equals(as_cstring(get_frame_register(top, top->pc)), "stack overflow");
+}
+
+void test_tail_call()
+{
+    // Calls in tail position replace the caller's frame, so these don't run out of
+    // stack memory.
+    Block block;
+    block.compile("def count(int i, int sum) -> int { if i == 0 { return sum } "
+        "return count(i - 1, sum + i) }");
+    block.compile("def is_even(int i) -> bool { if i == 0 { true } else { is_odd(i - 1) } }");
+    block.compile("def is_odd(int i) -> bool { if i == 0 { false } else { is_even(i - 1) } }");
+    Term* sum = block.compile("count(10000, 0)");
+    Term* even = block.compile("is_even(10001)");
+
+    Stack stack;
+    stack_set_memory_limit(&stack, 100 * 1000);
+    push_frame(&stack, &block);
+    run_interpreter(&stack);
+
+    test_assert(!stack.errorOccurred);
+    Frame* top = top_frame(&stack);
+    test_equals(get_frame_register(top, sum->index), "50005000");
+    test_equals(get_frame_register(top, even->index), "false");
+}
+
+void test_step_matches_full_run()
+{
+    // run_interpreter may use a different dispatch loop than run_interpreter_step, make
+    // sure that they produce the same result.
+    Block block;
+    Term* f = block.compile("def f(int a) -> int { b = a + 1; if b > 2 { b = b * 2 } "
+        "for i in [1 2 3] { b += i } return b }");
+
+    Stack fullRun;
+    push_frame(&fullRun, function_contents(f));
+    set_int(circa_input((caStack*) &fullRun, 0), 3);
+    run_interpreter(&fullRun);
+    test_equals(circa_int(circa_output((caStack*) &fullRun, 0)), 14);
+
+    Stack stepped;
+    push_frame(&stepped, function_contents(f));
+    set_int(circa_input((caStack*) &stepped, 0), 3);
+    for (int i=0; i < 1000; i++)
+        run_interpreter_step(&stepped);
+    test_equals(circa_int(circa_output((caStack*) &stepped, 0)), 14);
+}
+
 void register_tests()
 {
     REGISTER_TEST_CASE(interpreter::test_cast_first_inputs);
     REGISTER_TEST_CASE(interpreter::run_block_after_additions);
     REGISTER_TEST_CASE(interpreter::test_evaluate_minimum);
     REGISTER_TEST_CASE(interpreter::test_directly_call_native_override);
+    REGISTER_TEST_CASE(interpreter::test_packed_bytecode);
+    REGISTER_TEST_CASE(interpreter::test_input_frame_distance);
+    REGISTER_TEST_CASE(interpreter::test_last_use_inputs_are_moved);
+    REGISTER_TEST_CASE(interpreter::test_loop_accumulator_is_unshared);
+    REGISTER_TEST_CASE(interpreter::test_string_append_is_unshared);
+    REGISTER_TEST_CASE(interpreter::test_module_values_are_not_moved);
+    REGISTER_TEST_CASE(interpreter::test_static_field_access);
+    REGISTER_TEST_CASE(interpreter::test_frames_share_bytecode);
+    REGISTER_TEST_CASE(interpreter::test_register_windows);
+    REGISTER_TEST_CASE(interpreter::test_stack_overflow);
+    REGISTER_TEST_CASE(interpreter::test_tail_call);
+    REGISTER_TEST_CASE(interpreter::test_step_matches_full_run);
+    REGISTER_TEST_CASE(interpreter::test_call_native_inline);
 }
 
 } // namespace interpreter
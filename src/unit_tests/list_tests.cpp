@@ -0,0 +1,154 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "unit_test_common.h"
+
+#include "debug.h"
+#include "kernel.h"
+#include "list.h"
+
+namespace list_tests {
+
+void packed_ints()
+{
+    Value list;
+    set_packed_list(&list, TYPES.int_type, 100);
+    test_assert(list_packed_type(&list) == TYPES.int_type);
+    test_equals(list_length(&list), 100);
+
+    int* items = list_packed_ints(&list);
+    for (int i=0; i < 100; i++)
+        items[i] = i * 3;
+
+    Value element;
+    list_copy_element(&list, 10, &element);
+    test_assert(is_int(&element));
+    test_equals(as_int(&element), 30);
+
+    // A copy shares the data, and modifying it leaves the original alone.
+    Value copy1;
+    copy(&list, &copy1);
+    set_int(&element, -1);
+    set_index(&copy1, 5, &element);
+    test_assert(list_packed_type(&copy1) == TYPES.int_type);
+    test_equals(list_packed_ints(&copy1)[5], -1);
+    test_equals(list_packed_ints(&list)[5], 15);
+    test_assert(!equals(&list, &copy1));
+
+    // Shrinking stays packed.
+    list_resize(&copy1, 50);
+    test_assert(list_packed_type(&copy1) == TYPES.int_type);
+    test_equals(list_length(&copy1), 50);
+
+    Value slice;
+    list_slice(&list, 20, 30, &slice);
+    test_assert(list_packed_type(&slice) == TYPES.int_type);
+    test_equals(list_length(&slice), 10);
+    test_equals(list_packed_ints(&slice)[0], 60);
+}
+
+void unpack_on_access()
+{
+    Value list;
+    set_packed_list(&list, TYPES.float_type, 3);
+    float* items = list_packed_floats(&list);
+    items[0] = 1.5;
+    items[1] = 2.5;
+    items[2] = 3.5;
+
+    Value copy1;
+    copy(&list, &copy1);
+
+    // Reads don't change the storage.
+    Value element;
+    list_copy_element(&copy1, 1, &element);
+    test_equals(as_float(&element), 2.5);
+    test_equals(to_string(&copy1), "[1.5, 2.5, 3.5]");
+    test_assert(equals(&list, &copy1));
+    test_assert(list_packed_type(&list) == TYPES.float_type);
+    test_assert(list_packed_type(&copy1) == TYPES.float_type);
+
+    // list_get needs a caValue*, so the value gets its own unpacked list, with flat
+    // storage since it's small. The copy keeps the packed data.
+    test_assert(is_float(list_get(&list, 1)));
+    test_equals(as_float(list_get(&list, 1)), 2.5);
+    test_assert(list_packed_type(&list) == NULL);
+    test_assert(as_list_data(&list)->trie == NULL);
+    test_assert(list_packed_type(&copy1) == TYPES.float_type);
+    test_assert(equals(&list, &copy1));
+
+    set_string(list_append(&copy1), "end");
+    test_equals(list_length(&copy1), 4);
+    test_equals(list_length(&list), 3);
+    test_equals(to_string(&copy1), "[1.5, 2.5, 3.5, 'end']");
+
+    // A large list is unpacked to a trie.
+    Value large;
+    set_packed_list(&large, TYPES.int_type, ListTrieThreshold * 2);
+    list_packed_ints(&large)[300] = 7;
+    test_equals(as_int(list_get(&large, 300)), 7);
+    test_assert(as_list_data(&large)->trie != NULL);
+}
+
+void pack_existing_list()
+{
+    Value list;
+    set_list(&list, 3);
+    set_int(list_get(&list, 0), 1);
+    set_int(list_get(&list, 1), 2);
+    set_int(list_get(&list, 2), 3);
+
+    test_assert(!list_try_pack(&list, TYPES.float_type));
+    test_assert(list_try_pack(&list, TYPES.int_type));
+    test_assert(list_packed_type(&list) == TYPES.int_type);
+    test_equals(to_string(&list), "[1, 2, 3]");
+
+    Value boxed;
+    set_list(&boxed, 3);
+    set_int(list_get(&boxed, 0), 1);
+    set_int(list_get(&boxed, 1), 2);
+    set_int(list_get(&boxed, 2), 3);
+    test_assert(equals(&list, &boxed));
+    test_assert(list_packed_type(&list) == TYPES.int_type);
+    test_equals(get_hash_value(&list), get_hash_value(&boxed));
+
+    set_string(list_get(&boxed, 2), "x");
+    test_assert(!list_try_pack(&boxed, TYPES.int_type));
+}
+
+void read_shared_trie()
+{
+    Value list;
+    set_list(&list, 0);
+    for (int i=0; i < ListTrieThreshold * 4; i++)
+        set_int(list_append(&list), i);
+
+    // Modifying a copy gives it a new ListData that shares the original's trie nodes.
+    Value copy1;
+    copy(&list, &copy1);
+    set_int(list_append(&copy1), -1);
+
+    perf_stats_reset();
+
+    // Reading the modified copy must not unshare its nodes.
+    Value element;
+    list_copy_element(&copy1, 100, &element);
+    test_equals(as_int(&element), 100);
+    test_assert(list_contains(&copy1, &element));
+    test_assert(!equals(&copy1, &list));
+    to_string(&copy1);
+    get_hash_value(&copy1);
+
+#if CIRCA_ENABLE_PERF_STATS
+    test_equals(int(PERF_STATS[stat_ListTrieNodeCopy - c_firstStatIndex]), 0);
+#endif
+}
+
+void register_tests()
+{
+    REGISTER_TEST_CASE(list_tests::packed_ints);
+    REGISTER_TEST_CASE(list_tests::unpack_on_access);
+    REGISTER_TEST_CASE(list_tests::pack_existing_list);
+    REGISTER_TEST_CASE(list_tests::read_shared_trie);
+}
+
+} // namespace list_tests
@@ -9,6 +9,7 @@
 #include "string_type.h"
 
 std::vector<TestCase> gTestCases;
+std::vector<TestCase> gBenchmarks;
 
 TestCase gCurrentTestCase;
 
@@ -251,6 +252,23 @@ bool run_all_tests()
     return failureCount == 0;
 }
 
+bool run_benchmarks(std::string const& searchStr)
+{
+    int failureCount = 0;
+    std::vector<TestCase>::iterator it;
+    for (it = gBenchmarks.begin(); it != gBenchmarks.end(); ++it) {
+        if (it->name.find(searchStr) == std::string::npos)
+            continue;
+        std::cout << "Running " << it->name << std::endl;
+        if (!run_test(*it, false)) {
+            failureCount++;
+            std::cout << "Benchmark failed: " << it->name << std::endl;
+        }
+    }
+
+    return failureCount == 0;
+}
+
 void post_test_sanity_check()
 {
     // this once did something
@@ -339,18 +357,23 @@ namespace block { void register_tests(); }
 namespace c_objects { void register_tests(); }
 namespace code_iterators { void register_tests(); }
 namespace compound_type { void register_tests(); }
+namespace dict_tests { void register_tests(); }
 namespace fakefs { void register_tests(); }
 namespace file { void register_tests(); }
 namespace file_watch { void register_tests(); }
+namespace gc_tests { void register_tests(); }
 namespace handle { void register_tests(); }
+namespace hashtable_tests { void register_tests(); }
 namespace importing { void register_tests(); }
 namespace interpreter { void register_tests(); }
+namespace list_tests { void register_tests(); }
 namespace migration { void register_tests(); }
 namespace modules { void register_tests(); }
 namespace names { void register_tests(); }
 namespace native_patch_test { void register_tests(); }
 namespace string_tests { void register_tests(); }
 namespace tokenizer { void register_tests(); }
+namespace weak_ptr_tests { void register_tests(); }
 
 int main(int argc, char** argv)
 {
@@ -358,22 +381,30 @@ int main(int argc, char** argv)
     c_objects::register_tests();
     code_iterators::register_tests();
     compound_type::register_tests();
+    dict_tests::register_tests();
     fakefs::register_tests();
     file::register_tests();
     file_watch::register_tests();
+    gc_tests::register_tests();
     handle::register_tests();
+    hashtable_tests::register_tests();
     importing::register_tests();
     interpreter::register_tests();
+    list_tests::register_tests();
     migration::register_tests();
     modules::register_tests();
     names::register_tests();
     native_patch_test::register_tests();
     string_tests::register_tests();
     tokenizer::register_tests();
+    weak_ptr_tests::register_tests();
 
     caWorld* world = circa_initialize();
 
-    run_all_tests();
+    if (argc > 1 && std::string(argv[1]) == "-bench")
+        run_benchmarks(argc > 2 ? argv[2] : "");
+    else
+        run_all_tests();
 
     circa_shutdown(world);
 }
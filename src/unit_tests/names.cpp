@@ -180,6 +180,53 @@ void lookup_builtin_name()
     test_assert(existing_name_from_string("tok_Semicolon") == tok_Semicolon);
 }
 
+void intern_with_length()
+{
+    Name name = name_from_string("intern_test_name");
+    test_assert(existing_name_from_string("intern_test_name_and_more", 16) == name);
+    test_assert(existing_name_from_string("intern_test_nam", -1) == name_None);
+
+    // Builtin names are found with a length too.
+    test_assert(existing_name_from_string("Defaultxyz", 7) == name_Default);
+
+    // Qualified names know their sections.
+    Name qualified = name_from_string("intern_ns:intern_test_name");
+    test_assert(qualified_name_get_first_section(qualified)
+        == existing_name_from_string("intern_ns"));
+    test_assert(qualified_name_get_remainder_after_first_section(qualified) == name);
+    test_equals(name_to_string(qualified), "intern_ns:intern_test_name");
+}
+
+void name_index_follows_changes()
+{
+    Block block;
+    Term* a = block.compile("a = 1");
+    block.compile("b = 2");
+    Term* a2 = block.compile("a = 3");
+
+    test_assert(find_local_name(&block, "a") == a2);
+    test_assert(find_local_name(&block, "a", a2->index) == a);
+
+    // Renaming a term in the middle of the block.
+    Term* b = find_local_name(&block, "b");
+    rename(b, name_from_string("c"));
+    test_assert(find_local_name(&block, "b") == NULL);
+    test_assert(find_local_name(&block, "c") == b);
+
+    // Moving a term changes which binding is visible.
+    block.move(a2, 0);
+    test_assert(find_local_name(&block, "a") == a);
+    test_assert(find_local_name(&block, "a", 1) == a2);
+
+    // Names inside an included namespace.
+    block.compile("namespace ns { d = 4 }");
+    test_equals(term_value(find_local_name(&block, "ns:d")), "4");
+
+    // Removing a term.
+    remove_term(a);
+    test_assert(find_local_name(&block, "a") == a2);
+}
+
 void register_tests()
 {
     REGISTER_TEST_CASE(names::find_name);
@@ -190,6 +237,8 @@ void register_tests()
     REGISTER_TEST_CASE(names::bug_with_lookup_type_and_qualified_name);
     REGISTER_TEST_CASE(names::type_name_visible_from_module);
     REGISTER_TEST_CASE(names::lookup_builtin_name);
+    REGISTER_TEST_CASE(names::intern_with_length);
+    REGISTER_TEST_CASE(names::name_index_follows_changes);
 }
 
 } // namespace names
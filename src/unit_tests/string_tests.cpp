@@ -2,15 +2,17 @@
 
 #include "unit_test_common.h"
 
+#include "debug.h"
 #include "string_type.h"
 
 namespace string_tests {
 
 void test_sneaky_equals()
 {
+    // Use strings that are too long to be stored inline.
     Value val1, val2;
-    set_string(&val1, "Hello");
-    set_string(&val2, "Hello");
+    set_string(&val1, "Hello there");
+    set_string(&val2, "Hello there");
 
     // initial: strings are stored differently.
     test_assert(circa_string(&val1) != circa_string(&val2));
@@ -21,9 +23,125 @@ void test_sneaky_equals()
     test_assert(circa_string(&val1) == circa_string(&val2));
 }
 
+void small_strings()
+{
+    perf_stats_reset();
+
+    Value a, b;
+    set_string(&a, "abc");
+    copy(&a, &b);
+    string_append(&b, "d");
+
+#if CIRCA_ENABLE_PERF_STATS && CIRCA_ENABLE_SMALL_STRINGS
+    test_equals(int(PERF_STATS[stat_StringCreate - c_firstStatIndex]), 0);
+#endif
+
+    test_equals(&a, "abc");
+    test_equals(&b, "abcd");
+    test_equals(string_length(&b), 4);
+
+    // Grow past the inline capacity, then shrink back down.
+    string_append(&b, "efghijklmnop");
+    test_equals(&b, "abcdefghijklmnop");
+    test_equals(string_length(&b), 16);
+
+    string_resize(&b, 2);
+    test_equals(&b, "ab");
+    test_equals(string_length(&b), 2);
+
+    Value c;
+    set_string(&c, "ab");
+    test_assert(equals(&b, &c));
+    test_assert(!equals(&a, &c));
+
+    set_string(&c, "");
+    test_equals(string_length(&c), 0);
+    test_assert(string_eq(&c, ""));
+
+    Value slice;
+    string_slice(&a, 1, -1, &slice);
+    test_equals(&slice, "bc");
+}
+
+void cached_hash()
+{
+    Value a, b;
+    set_string(&a, "a string that lives on the heap");
+    set_string(&b, "a string that lives on the heap");
+
+    test_equals(get_hash_value(&a), (int) hash_cstring(as_cstring(&a)));
+    test_equals(get_hash_value(&a), get_hash_value(&b));
+
+    // The cached hash must be reset when the string changes.
+    string_append(&a, "!");
+    test_equals(get_hash_value(&a), (int) hash_cstring(as_cstring(&a)));
+    test_assert(!equals(&a, &b));
+
+    set_string(&b, "tiny");
+    test_equals(get_hash_value(&b), (int) hash_cstring("tiny"));
+}
+
+void remove_suffix()
+{
+    Value s;
+    set_string(&s, "filename.ca");
+    string_remove_suffix(&s, ".ca");
+    test_equals(&s, "filename");
+    test_equals(string_length(&s), 8);
+}
+
+void append_to_self()
+{
+    // as_cstring points inside the value for small strings, so appending or assigning
+    // a string's own characters must not read them after they have been overwritten.
+    Value s;
+    set_string(&s, "abc");
+    string_append(&s, as_cstring(&s));
+    test_equals(&s, "abcabc");
+
+    string_append(&s, as_cstring(&s));
+    test_equals(&s, "abcabcabcabc");
+
+    set_string(&s, "xyz");
+    set_string(&s, as_cstring(&s) + 1, 2);
+    test_equals(&s, "yz");
+}
+
+void repeated_append()
+{
+    perf_stats_reset();
+
+    Value s;
+    set_string(&s, "");
+    for (int i=0; i < 10000; i++)
+        string_append_char(&s, 'a' + (i % 26));
+
+    test_equals(string_length(&s), 10000);
+    test_equals(string_get(&s, 9999), 'a' + (9999 % 26));
+
+#if CIRCA_ENABLE_PERF_STATS
+    // The buffer grows geometrically, so only a few appends need to reallocate.
+    int grows = int(PERF_STATS[stat_StringBufferGrow - c_firstStatIndex]);
+    test_assert(grows < 40);
+#endif
+
+    // Appending to a shared string leaves the other copy alone.
+    Value copy1;
+    copy(&s, &copy1);
+    string_append(&copy1, "!");
+    test_equals(string_length(&s), 10000);
+    test_equals(string_length(&copy1), 10001);
+    test_equals(string_get(&copy1, 10000), '!');
+}
+
 void register_tests()
 {
-    REGISTER_TEST_CASE(test_sneaky_equals);
+    REGISTER_TEST_CASE(string_tests::test_sneaky_equals);
+    REGISTER_TEST_CASE(string_tests::small_strings);
+    REGISTER_TEST_CASE(string_tests::cached_hash);
+    REGISTER_TEST_CASE(string_tests::remove_suffix);
+    REGISTER_TEST_CASE(string_tests::append_to_self);
+    REGISTER_TEST_CASE(string_tests::repeated_append);
 }
 
 } // namespace string_tests
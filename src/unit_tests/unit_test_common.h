@@ -58,11 +58,20 @@ extern std::vector<TestCase> gTestCases;
 
 #define REGISTER_TEST_CASE(f) gTestCases.push_back(TestCase(#f,f))
 
+// Benchmarks are kept out of the normal test run. They only run when the unit_tests
+// binary is started with '-bench', optionally followed by a name filter.
+extern std::vector<TestCase> gBenchmarks;
+
+#define REGISTER_BENCHMARK(f) gBenchmarks.push_back(TestCase(#f,f))
+
 bool run_tests(std::string const& searchStr);
 
 // Run all unit tests, returns true if all passed.
 bool run_all_tests();
 
+// Run the benchmarks whose names contain 'searchStr'.
+bool run_benchmarks(std::string const& searchStr);
+
 std::vector<std::string> list_all_test_names();
 std::string get_current_test_name();
 void declare_current_test_failed();
@@ -0,0 +1,68 @@
+// Copyright (c) Andrew Fischer. See LICENSE file for license terms.
+
+#include "unit_test_common.h"
+
+#include "weak_ptrs.h"
+
+namespace weak_ptr_tests {
+
+void create_and_null()
+{
+    int a = 1;
+    int b = 2;
+
+    WeakPtr ptrA = weak_ptr_create(&a);
+    WeakPtr ptrB = weak_ptr_create(&b);
+    test_assert(ptrA != 0);
+    test_assert(ptrA != ptrB);
+    test_assert(get_weak_ptr(ptrA) == &a);
+    test_assert(get_weak_ptr(ptrB) == &b);
+    test_assert(!is_weak_ptr_null(ptrA));
+
+    weak_ptr_set_null(ptrA);
+    test_assert(get_weak_ptr(ptrA) == NULL);
+    test_assert(is_weak_ptr_null(ptrA));
+    test_assert(get_weak_ptr(ptrB) == &b);
+
+    // Setting it null again does nothing.
+    weak_ptr_set_null(ptrA);
+    test_assert(get_weak_ptr(ptrB) == &b);
+
+    test_assert(is_weak_ptr_null(0));
+    test_assert(get_weak_ptr(0) == NULL);
+
+    weak_ptr_set_null(ptrB);
+}
+
+void slots_are_reused()
+{
+    int a = 1;
+    int b = 2;
+
+    WeakPtr first = weak_ptr_create(&a);
+    weak_ptr_set_null(first);
+    int slotCount = weak_ptr_slot_count();
+
+    // The freed slot is reused, but the old handle stays null.
+    WeakPtr second = weak_ptr_create(&b);
+    test_assert(second != first);
+    test_equals(weak_ptr_slot_count(), slotCount);
+    test_assert(get_weak_ptr(first) == NULL);
+    test_assert(get_weak_ptr(second) == &b);
+
+    // Creating and freeing in a loop doesn't grow the table.
+    for (int i=0; i < 10000; i++)
+        weak_ptr_set_null(weak_ptr_create(&a));
+    test_assert(weak_ptr_slot_count() <= slotCount + 1);
+
+    test_assert(get_weak_ptr(second) == &b);
+    weak_ptr_set_null(second);
+}
+
+void register_tests()
+{
+    REGISTER_TEST_CASE(weak_ptr_tests::create_and_null);
+    REGISTER_TEST_CASE(weak_ptr_tests::slots_are_reused);
+}
+
+} // namespace weak_ptr_tests
@@ -53,6 +53,10 @@ void fix_forward_function_references(Block* block)
 void dirty_bytecode(Block* block)
 {
     set_null(&block->bytecode);
+    if (block->packedBytecode != NULL) {
+        bytecode_decref(block->packedBytecode);
+        block->packedBytecode = NULL;
+    }
 }
 
 void refresh_bytecode(Block* block)
@@ -61,8 +65,12 @@ void refresh_bytecode(Block* block)
     if (global_world()->bootstrapStatus == name_Bootstrapping)
         return;
 
-    if (is_null(&block->bytecode))
+    if (is_null(&block->bytecode)) {
         write_block_bytecode(block, &block->bytecode);
+        ca_assert(block->packedBytecode == NULL);
+        block->packedBytecode = bytecode_create();
+        bytecode_compile(block, &block->bytecode, block->packedBytecode);
+    }
 }
 
 } // namespace circa
@@ -1,41 +1,189 @@
 // Copyright (c) Andrew Fischer. See LICENSE file for license terms.
 
-#include <vector>
+#include "common_headers.h"
+
+#include "circa/thread.h"
 
 #include "weak_ptrs.h"
 
 namespace circa {
 
-std::vector<void*> g_everyWeakPtr;
+// Slots are stored in fixed-size chunks that never move once they are allocated, so
+// get_weak_ptr can read a slot without taking a lock. The chunk pointers and the slot
+// count are published with release stores, after the slot is written.
+//
+// Creating and freeing slots is serialized with g_weakPtrMutex, which is created by
+// weak_ptr_init_global_data during circa_initialize.
+//
+// A slot can be freed and reused while get_weak_ptr is reading it, so the reader checks
+// the generation both before and after it reads the address (like a seqlock). Writers
+// bump the generation before they change the address.
+
+const int WeakPtrChunkSize = 1024;
+const int WeakPtrMaxChunks = 4096;
+
+// Bits of a WeakPtr used for the slot index, the rest hold the generation.
+const int WeakPtrIndexBits = sizeof(WeakPtr) >= 8 ? 32 : 22;
+const WeakPtr WeakPtrIndexMask = ((WeakPtr) 1 << WeakPtrIndexBits) - 1;
+const WeakPtr WeakPtrGenerationMask = ~(WeakPtr) 0 >> WeakPtrIndexBits;
+
+struct WeakPtrSlot {
+    void* address;
+    WeakPtr generation;
+
+    // Next slot on the free list, or 0.
+    int nextFree;
+};
+
+WeakPtrSlot* g_weakPtrChunks[WeakPtrMaxChunks];
+
+// Slot 0 is never used, so that a WeakPtr of 0 means null.
+int g_weakPtrSlotCount = 0;
+int g_weakPtrFirstFree = 0;
+caMutex* g_weakPtrMutex = NULL;
+
+template <typename T>
+static T load_acquire(T* ptr)
+{
+#ifdef __GNUC__
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+    return *(volatile T*) ptr;
+#endif
+}
+
+template <typename T>
+static void store_release(T* ptr, T value)
+{
+#ifdef __GNUC__
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#else
+    *(volatile T*) ptr = value;
+#endif
+}
+
+static WeakPtrSlot* get_slot(int index)
+{
+    return &g_weakPtrChunks[index / WeakPtrChunkSize][index % WeakPtrChunkSize];
+}
+
+static WeakPtrSlot* find_live_slot(WeakPtr ptr)
+{
+    int index = (int) (ptr & WeakPtrIndexMask);
+    if (index == 0 || index >= load_acquire(&g_weakPtrSlotCount))
+        return NULL;
+
+    WeakPtrSlot* slot = get_slot(index);
+    if (load_acquire(&slot->generation) != ptr >> WeakPtrIndexBits)
+        return NULL;
+    return slot;
+}
+
+static int allocate_slot()
+{
+    if (g_weakPtrFirstFree != 0) {
+        int index = g_weakPtrFirstFree;
+        g_weakPtrFirstFree = get_slot(index)->nextFree;
+        return index;
+    }
+
+    if (g_weakPtrSlotCount == 0)
+        g_weakPtrSlotCount = 1;
+
+    int index = g_weakPtrSlotCount;
+    int chunk = index / WeakPtrChunkSize;
+    ca_assert(chunk < WeakPtrMaxChunks);
+
+    if (g_weakPtrChunks[chunk] == NULL) {
+        WeakPtrSlot* slots = (WeakPtrSlot*) calloc(WeakPtrChunkSize, sizeof(WeakPtrSlot));
+        store_release(&g_weakPtrChunks[chunk], slots);
+    }
+    return index;
+}
+
+void weak_ptr_init_global_data()
+{
+    if (g_weakPtrMutex == NULL)
+        g_weakPtrMutex = circa_create_mutex();
+}
 
 WeakPtr weak_ptr_create(void* address)
 {
-    // Make sure we don't give out a value of 0, because this means null.
-    if (g_everyWeakPtr.size() == 0)
-        g_everyWeakPtr.push_back(NULL);
+    circa_thread_mutex_lock(g_weakPtrMutex);
+
+    int index = allocate_slot();
+    WeakPtrSlot* slot = get_slot(index);
+    store_release(&slot->address, address);
+    slot->nextFree = 0;
+
+    // Publish a newly allocated slot after it's written.
+    if (index == g_weakPtrSlotCount)
+        store_release(&g_weakPtrSlotCount, index + 1);
 
-    g_everyWeakPtr.push_back(address);
-    return (int) g_everyWeakPtr.size() - 1;
+    WeakPtr ptr = (slot->generation << WeakPtrIndexBits) | (WeakPtr) index;
+
+    circa_thread_mutex_unlock(g_weakPtrMutex);
+    return ptr;
 }
 
 void* get_weak_ptr(WeakPtr ptr)
 {
-    if (ptr >= g_everyWeakPtr.size())
+    WeakPtrSlot* slot = find_live_slot(ptr);
+    if (slot == NULL)
         return NULL;
-    return g_everyWeakPtr[ptr];
+
+    void* address = load_acquire(&slot->address);
+
+    // If the slot was freed (and maybe reused) since the generation was checked, then
+    // 'address' may belong to a different object.
+    if (load_acquire(&slot->generation) != ptr >> WeakPtrIndexBits)
+        return NULL;
+    return address;
 }
 
 void weak_ptr_set_null(WeakPtr ptr)
 {
-    if (ptr == 0)
+    if (ptr == 0 || load_acquire(&g_weakPtrSlotCount) == 0)
         return;
-    g_everyWeakPtr[ptr] = NULL;
+
+    circa_thread_mutex_lock(g_weakPtrMutex);
+
+    WeakPtrSlot* slot = find_live_slot(ptr);
+    if (slot != NULL) {
+        int index = (int) (ptr & WeakPtrIndexMask);
+
+        // Bump the generation first, so that every existing handle reads as null.
+        store_release(&slot->generation, (slot->generation + 1) & WeakPtrGenerationMask);
+        store_release(&slot->address, (void*) NULL);
+        slot->nextFree = g_weakPtrFirstFree;
+        g_weakPtrFirstFree = index;
+    }
+
+    circa_thread_mutex_unlock(g_weakPtrMutex);
 }
+
 bool is_weak_ptr_null(WeakPtr ptr)
 {
-    if (ptr == 0)
-        return true;
-    return ptr == 0;
+    return get_weak_ptr(ptr) == NULL;
 }
 
+int weak_ptr_slot_count()
+{
+    int count = load_acquire(&g_weakPtrSlotCount);
+    return count == 0 ? 0 : count - 1;
 }
+
+void weak_ptr_dealloc_global_data()
+{
+    for (int i=0; i < WeakPtrMaxChunks; i++) {
+        free(g_weakPtrChunks[i]);
+        g_weakPtrChunks[i] = NULL;
+    }
+    g_weakPtrSlotCount = 0;
+    g_weakPtrFirstFree = 0;
+    if (g_weakPtrMutex != NULL)
+        circa_destroy_mutex(g_weakPtrMutex);
+    g_weakPtrMutex = NULL;
+}
+
+} // namespace circa
@@ -6,11 +6,28 @@
 
 namespace circa {
 
+// Weak pointers
+//
+// A WeakPtr is a handle to a slot in a global table. The low bits of the handle are the
+// slot index and the high bits are the slot's generation. weak_ptr_set_null bumps the
+// generation and puts the slot on a free list, so the slot can be reused by a later
+// weak_ptr_create while every old handle to it reads as NULL.
+//
+// A WeakPtr of 0 is always null.
+
 typedef size_t WeakPtr;
 
+// Called by circa_initialize, before any weak pointers are created.
+void weak_ptr_init_global_data();
+
 WeakPtr weak_ptr_create(void* address);
 void* get_weak_ptr(WeakPtr ptr);
 void weak_ptr_set_null(WeakPtr ptr);
 bool is_weak_ptr_null(WeakPtr ptr);
 
+// Number of slots that have been allocated, including free ones.
+int weak_ptr_slot_count();
+
+void weak_ptr_dealloc_global_data();
+
 } // namespace circa
@@ -78,6 +78,7 @@ void refresh_all_modules(caWorld* world)
 
             if (existing != latest) {
                 term->nestedContents = latest;
+                gc_write_barrier((CircaObject*) term->owningBlock, &latest->header);
 
                 update_world_after_module_reload(world, existing, latest);
             }